@@ -42,6 +42,14 @@ using namespace QSanProtocol;
 
 Client *ClientInstance = NULL;
 
+namespace {
+    // 1s, 2s, 4s, 8s, 8s, 8s: about half a minute, the server keeps the packets we miss for no longer than that
+    // in a busy game. Then we start over without a serial, and give up after as many attempts again.
+    const int maxResumeAttempts = 6;
+    const int firstResumeDelay = 1000;
+    const int maxResumeDelay = 8000;
+}
+
 Client::Client(QObject *parent, const QString &filename)
     : QObject(parent), m_isDiscardActionRefusable(true),
     status(NotActive), alive_count(1), swap_pile(0),
@@ -50,8 +58,16 @@ Client::Client(QObject *parent, const QString &filename)
 {
     ClientInstance = this;
     m_isGameOver = false;
+    _m_lastReceivedSerial = 0;
+    _m_isResuming = false;
+    _m_isRebuilding = false;
+    _m_resumeAttempts = 0;
+    _m_resumeTimer = new QTimer(this);
+    _m_resumeTimer->setSingleShot(true);
+    connect(_m_resumeTimer, &QTimer::timeout, this, &Client::retryResume);
 
     callbacks[S_COMMAND_CHECK_VERSION] = &Client::checkVersion;
+    callbacks[S_COMMAND_PROTOCOL_FEATURES] = &Client::offerFeatures;
     callbacks[S_COMMAND_SETUP] = &Client::setup;
     callbacks[S_COMMAND_NETWORK_DELAY_TEST] = &Client::networkDelayTest;
     callbacks[S_COMMAND_ADD_PLAYER] = &Client::addPlayer;
@@ -92,6 +108,7 @@ Client::Client(QObject *parent, const QString &filename)
     callbacks[S_COMMAND_SET_DASHBOARD_SHADOW] = &Client::setDashboardShadow;
     callbacks[S_COMMAND_UPDATE_STATE_ITEM] = &Client::updateStateItem;
     callbacks[S_COMMAND_AVAILABLE_CARDS] = &Client::setAvailableCards;
+    callbacks[S_COMMAND_ROOM_SNAPSHOT] = &Client::applyRoomSnapshot;
     callbacks[S_COMMAND_GET_CARD] = &Client::getCards;
     callbacks[S_COMMAND_LOSE_CARD] = &Client::loseCards;
     callbacks[S_COMMAND_SET_PROPERTY] = &Client::updateProperty;
@@ -167,6 +184,7 @@ Client::Client(QObject *parent, const QString &filename)
         connect(socket, &NativeClientSocket::message_got, recorder, &Recorder::recordLine);
         connect(socket, &NativeClientSocket::message_got, this, &Client::processServerPacket);
         connect(socket, &NativeClientSocket::error_message, this, &Client::error_message);
+        connect(socket, &NativeClientSocket::disconnected, this, &Client::resumeSession);
         socket->connectToHost();
 
         replayer = NULL;
@@ -322,7 +340,7 @@ void Client::replyToServer(CommandType command, const QVariant &arg)
         Packet packet(S_SRC_CLIENT | S_TYPE_REPLY | S_DEST_ROOM, command);
         packet.localSerial = _m_lastServerSerial;
         packet.setMessageBody(arg);
-        socket->send(packet.toJson());
+        socket->send(packet.toByteArray(socket->protocolFeatures()));
     }
 }
 
@@ -336,7 +354,7 @@ void Client::requestServer(CommandType command, const QVariant &arg)
     if (socket) {
         Packet packet(S_SRC_CLIENT | S_TYPE_REQUEST | S_DEST_ROOM, command);
         packet.setMessageBody(arg);
-        socket->send(packet.toJson());
+        socket->send(packet.toByteArray(socket->protocolFeatures()));
     }
 }
 
@@ -345,7 +363,7 @@ void Client::notifyServer(CommandType command, const QVariant &arg)
     if (socket) {
         Packet packet(S_SRC_CLIENT | S_TYPE_NOTIFICATION | S_DEST_ROOM, command);
         packet.setMessageBody(arg);
-        socket->send(packet.toJson());
+        socket->send(packet.toByteArray(socket->protocolFeatures()));
     }
 }
 
@@ -355,8 +373,49 @@ void Client::request(const QByteArray &raw)
         socket->send(raw);
 }
 
+void Client::applyRoomSnapshot(const QVariant &arg)
+{
+    JsonArray body = arg.value<JsonArray>();
+    if (body.size() != 2 || body.at(0).toInt() != S_ROOM_SNAPSHOT_VERSION)
+        return;
+
+    // all the notifications are handled in one go, so the state is never shown half restored
+    foreach (const QVariant &item, body.at(1).value<JsonArray>()) {
+        JsonArray command = item.value<JsonArray>();
+        Callback callback = callbacks[static_cast<CommandType>(command.value(0).toInt())];
+        if (callback)
+            (this->*callback)(command.value(1));
+    }
+}
+
 void Client::checkVersion(const QVariant &server_version)
 {
+    if (!JsonUtils::isString(server_version)) {
+        // the server accepted some of the features we offered, in the form of [version, features]
+        JsonArray body = server_version.value<JsonArray>();
+        int features = body.value(1).toInt();
+        if (socket) {
+            if (features & S_FEATURE_LENGTH_PREFIXED_FRAME)
+                socket->setFraming(ClientSocket::LengthPrefixedFraming);
+            socket->setProtocolFeatures(features);
+        }
+
+        if (_m_isResuming) {
+            _m_isResuming = false;
+            JsonArray arg;
+            arg << true;
+            arg << Config.UserName;
+            arg << Config.UserAvatar;
+            arg << _m_lastReceivedSerial;
+            notifyServer(S_COMMAND_SIGNUP, arg);
+        }
+        return;
+    }
+
+    // we are in the game already, just sign up again after the negotiation
+    if (_m_isResuming)
+        return;
+
     QString version = server_version.toString();
     QString version_number, mod_name;
     if (version.contains(QChar(':'))) {
@@ -371,11 +430,22 @@ void Client::checkVersion(const QVariant &server_version)
     emit version_checked(version_number, mod_name);
 }
 
+void Client::offerFeatures(const QVariant &server_features)
+{
+    // only a server which sent this understands the offer, a legacy one takes it as an invalid signup
+    int features = server_features.toInt() & S_SUPPORTED_FEATURES;
+    if (socket && features != S_FEATURE_NONE)
+        notifyServer(S_COMMAND_CHECK_VERSION, JsonArray() << Sanguosha->getVersion() << features);
+}
+
 void Client::setup(const QVariant &setup_json)
 {
     if (socket && !socket->isConnected())
         return;
 
+    if (_m_isResuming)
+        return;
+
     QString setup_str = setup_json.toString();
     if (ServerInfo.parse(setup_str)) {
         emit server_connected();
@@ -385,9 +455,85 @@ void Client::setup(const QVariant &setup_json)
     }
 }
 
+void Client::resumeSession()
+{
+    // The server keeps the packets sent to us for a while. Reconnecting at once, we get only the ones we missed.
+    // Without a serial, i.e. after rebuildSession(), the server sends the whole state instead.
+    if (m_isGameOver || socket == NULL)
+        return;
+
+    if (_m_isResuming) {
+        // the connection made by retryResume() dropped before the server acknowledged it, the attempts go on
+        retryResume();
+        return;
+    }
+
+    if (!(socket->protocolFeatures() & S_FEATURE_SESSION_RESUME))
+        return;
+    if (_m_lastReceivedSerial == 0 && !_m_isRebuilding)
+        return;
+
+    _m_isRebuilding = false;
+    _m_resumeAttempts = 0;
+    _m_isResuming = true;
+    socket->setFraming(ClientSocket::LineFraming);
+    socket->setProtocolFeatures(S_FEATURE_NONE);
+    retryResume();
+}
+
+void Client::retryResume()
+{
+    // the server acknowledged the negotiation of the new connection, or we gave up
+    if (!_m_isResuming || socket == NULL)
+        return;
+    // still waiting for the acknowledgement, which clears _m_isResuming, or for the connection to drop
+    if (socket->isConnected())
+        return;
+
+    if (_m_resumeAttempts == maxResumeAttempts) {
+        if (_m_lastReceivedSerial == 0) {
+            _m_isResuming = false;
+            emit error_message(tr("Can not reconnect to the server"));
+            return;
+        }
+        // the packets we missed are gone by now, the server has to send the whole state instead
+        rebuildSession();
+        _m_resumeAttempts = 0;
+    }
+
+    socket->connectToHost();
+    _m_resumeTimer->start(qMin(firstResumeDelay << _m_resumeAttempts, maxResumeDelay));
+    ++_m_resumeAttempts;
+}
+
+void Client::rebuildSession()
+{
+    // The session can't be resumed, either the server told us so and is closing the connection,
+    // or we couldn't reconnect in time. The other players are dropped here, as the server introduces them again with the whole state.
+    foreach (ClientPlayer *player, findChildren<ClientPlayer *>()) {
+        if (player != Self)
+            removePlayer(player->objectName());
+    }
+
+    // Self stays, everything is bound to it, but its state is sent again by moves and marks which would add to it
+    foreach (const Skill *skill, Self->getVisibleSkills())
+        emit skill_detached(skill->objectName());
+    Self->detachAllSkills();
+    Self->clearCardsAndMarks();
+    Self->clearFlags();
+    Self->clearHistory();
+    Self->clearCardLimitation();
+
+    _m_lastReceivedSerial = 0;
+    _m_isRebuilding = true;
+}
+
 void Client::disconnectFromHost()
 {
     if (socket) {
+        disconnect(socket, &ClientSocket::disconnected, this, &Client::resumeSession);
+        _m_isResuming = false;
+        _m_resumeTimer->stop();
         socket->disconnectFromHost();
         socket = NULL;
     }
@@ -400,6 +546,9 @@ void Client::processServerPacket(const QByteArray &cmd)
     if (m_isGameOver) return;
     Packet packet;
     if (packet.parse(cmd)) {
+        if (packet.globalSerial != 0)
+            _m_lastReceivedSerial = packet.globalSerial;
+
         if (packet.getPacketType() == S_TYPE_NOTIFICATION) {
             Callback callback = callbacks[packet.getCommandType()];
             if (callback) {
@@ -1560,6 +1709,12 @@ void Client::revivePlayer(const QVariant &player)
 void Client::warn(const QVariant &reason_var)
 {
     QString reason = reason_var.toString();
+    if (reason == "SESSION_EXPIRED" && socket) {
+        // sign up again once the server closed the connection, see resumeSession()
+        rebuildSession();
+        return;
+    }
+
     QString msg;
     if (reason == "GAME_OVER")
         msg = tr("Game is over now");
@@ -1567,6 +1722,8 @@ void Client::warn(const QVariant &reason_var)
         msg = tr("Invalid signup string");
     else if (reason == "LEVEL_LIMITATION")
         msg = tr("Your level is not enough");
+    else if (reason == "SESSION_EXPIRED")
+        msg = tr("The connection has been lost for too long, please reconnect");
     else
         msg = tr("Unknown warning: %1").arg(reason);
 
@@ -32,6 +32,7 @@
 class Recorder;
 class Replayer;
 class QTextDocument;
+class QTimer;
 
 class Client : public QObject
 {
@@ -123,7 +124,9 @@ public:
     typedef void (Client::*Callback) (const QVariant &);
 
     void checkVersion(const QVariant &server_version);
+    void offerFeatures(const QVariant &server_features);
     void setup(const QVariant &setup_str);
+    void applyRoomSnapshot(const QVariant &arg);
     void networkDelayTest(const QVariant &);
     void addPlayer(const QVariant &player_info);
     void removePlayer(const QVariant &player_name);
@@ -308,6 +311,11 @@ private:
     QList<int> available_cards;
 
     unsigned int _m_lastServerSerial;
+    unsigned int _m_lastReceivedSerial; // of any packet, for resuming the session
+    bool _m_isResuming;
+    bool _m_isRebuilding; // the session expired, the next reconnection fetches the whole state
+    int _m_resumeAttempts;
+    QTimer *_m_resumeTimer;
 
     void updatePileNum();
     QString setPromptList(const QStringList &text);
@@ -316,9 +324,12 @@ private:
 
     bool _loseSingleCard(int card_id, CardsMoveStruct move);
     bool _getSingleCard(int card_id, CardsMoveStruct move);
+    void rebuildSession();
 
 private slots:
     void processServerPacket(const QByteArray &cmd);
+    void resumeSession();
+    void retryResume();
     bool processServerRequest(const QSanProtocol::Packet &packet);
     void processObsoleteServerPacket(const QString &cmd);
     void notifyRoleChange(const QString &new_role);
@@ -210,6 +210,27 @@ void ClientPlayer::setHandcardNum(int n)
     handcard_num = n;
 }
 
+void ClientPlayer::clearCardsAndMarks()
+{
+    handcard_num = 0;
+    known_cards.clear();
+    visible_cards.clear();
+
+    foreach (const Card *equip, getEquips())
+        removeCard(equip, PlaceEquip);
+    foreach (const Card *trick, getJudgingArea())
+        removeCard(trick, PlaceDelayedTrick);
+
+    foreach (const QString &name, piles.keys()) {
+        piles.remove(name);
+        if (!name.startsWith("#") && !name.startsWith("^"))
+            emit pile_changed(name);
+    }
+
+    foreach (const QString &mark, marks.keys())
+        setMark(mark, 0);
+}
+
 QString ClientPlayer::getGameMode() const
 {
     return ServerInfo.GameMode;
@@ -43,6 +43,8 @@ public:
     void changePile(const QString &name, bool add, QList<int> card_ids);
     QString getDeathPixmapPath() const;
     void setHandcardNum(int n);
+    // drops the cards and marks, before the whole state is sent again
+    void clearCardsAndMarks();
     virtual QString getGameMode() const;
 
     virtual void setFlags(const QString &flag);
@@ -24,6 +24,7 @@ HEADERS += \
     src/nativesocket.h \
     src/socket.h \
     src/util.h \
+    src/random.h \
     src/settings.h
 
 SOURCES += \
@@ -32,6 +33,7 @@ SOURCES += \
     src/protocol.cpp \
     src/nativesocket.cpp \
     src/util.cpp \
+    src/random.cpp \
     src/settings.cpp
 
 DESTDIR = $$OUT_PWD/../dist/lib
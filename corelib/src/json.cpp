@@ -20,7 +20,12 @@
 
 #include "json.h"
 
-class JsonDocumentPrivate
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+class JsonDocumentPrivate : public QSharedData
 {
 public:
     QVariant value;
@@ -28,6 +33,524 @@ public:
     QString error;
 };
 
+// The JSON text is read into and written from JsonArray / JsonObject directly,
+// instead of going through QJsonDocument and converting the whole tree into QVariant afterwards.
+namespace {
+    // the same as QJsonDocument
+    const int maxJsonDepth = 1024;
+
+    class JsonReader
+    {
+    public:
+        JsonReader(const char *data, int length, bool allowComment)
+            : begin(data), p(data), end(data + length), depth(0), allowComment(allowComment), unterminatedComment(false)
+        {
+        }
+
+        bool parse(QVariant &value)
+        {
+            skipWhitespace();
+            if (p >= end || (*p != '[' && *p != '{'))
+                return fail(QStringLiteral("JSON text should be an array or an object"));
+            if (!parseValue(value))
+                return false;
+            skipWhitespace();
+            if (p != end)
+                return fail(QStringLiteral("garbage at the end of the document"));
+            return true;
+        }
+
+        QString error;
+
+    private:
+        const char *begin;
+        const char *p;
+        const char *end;
+        int depth;
+        bool allowComment;
+        bool unterminatedComment;
+
+        bool fail(const QString &reason)
+        {
+            if (unterminatedComment)
+                error = QStringLiteral("unterminated comment");
+            else
+                error = QStringLiteral("%1 at offset %2").arg(reason).arg(p - begin);
+            return false;
+        }
+
+        // comments are skipped as whitespace while scanning, so they never appear inside a token
+        void skipWhitespace()
+        {
+            while (p < end) {
+                char c = *p;
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+                    ++p;
+                } else if (allowComment && c == '/' && end - p >= 2 && p[1] == '/') {
+                    p += 2;
+                    while (p < end && *p != '\n')
+                        ++p;
+                } else if (allowComment && c == '/' && end - p >= 2 && p[1] == '*') {
+                    const char *commentEnd = nullptr;
+                    for (const char *i = p + 2; i + 1 < end; ++i) {
+                        if (i[0] == '*' && i[1] == '/') {
+                            commentEnd = i + 2;
+                            break;
+                        }
+                    }
+                    if (commentEnd == nullptr) {
+                        unterminatedComment = true;
+                        p = end;
+                        return;
+                    }
+                    p = commentEnd;
+                } else {
+                    return;
+                }
+            }
+        }
+
+        bool match(const char *literal, int length)
+        {
+            if (end - p < length || memcmp(p, literal, length) != 0)
+                return false;
+            p += length;
+            return true;
+        }
+
+        bool parseValue(QVariant &value)
+        {
+            if (p >= end)
+                return fail(QStringLiteral("unexpected end of the document"));
+
+            switch (*p) {
+            case '[':
+                return parseArray(value);
+            case '{':
+                return parseObject(value);
+            case '"': {
+                QString str;
+                if (!parseString(str))
+                    return false;
+                value = str;
+                return true;
+            }
+            case 't':
+                if (!match("true", 4))
+                    return fail(QStringLiteral("illegal value"));
+                value = true;
+                return true;
+            case 'f':
+                if (!match("false", 5))
+                    return fail(QStringLiteral("illegal value"));
+                value = false;
+                return true;
+            case 'n':
+                if (!match("null", 4))
+                    return fail(QStringLiteral("illegal value"));
+                value = QVariant();
+                return true;
+            default:
+                return parseNumber(value);
+            }
+        }
+
+        bool parseArray(QVariant &value)
+        {
+            if (++depth > maxJsonDepth)
+                return fail(QStringLiteral("too deeply nested document"));
+
+            ++p; // '['
+            JsonArray array;
+            skipWhitespace();
+            if (p < end && *p == ']') {
+                ++p;
+            } else {
+                forever {
+                    skipWhitespace();
+                    array << QVariant();
+                    if (!parseValue(array.last()))
+                        return false;
+                    skipWhitespace();
+                    if (p < end && *p == ',') {
+                        ++p;
+                    } else if (p < end && *p == ']') {
+                        ++p;
+                        break;
+                    } else {
+                        return fail(QStringLiteral("missing value separator"));
+                    }
+                }
+            }
+
+            --depth;
+            value = array;
+            return true;
+        }
+
+        bool parseObject(QVariant &value)
+        {
+            if (++depth > maxJsonDepth)
+                return fail(QStringLiteral("too deeply nested document"));
+
+            ++p; // '{'
+            JsonObject object;
+            skipWhitespace();
+            if (p < end && *p == '}') {
+                ++p;
+            } else {
+                forever {
+                    skipWhitespace();
+                    if (p >= end || *p != '"')
+                        return fail(QStringLiteral("object key should be a string"));
+                    QString key;
+                    if (!parseString(key))
+                        return false;
+                    skipWhitespace();
+                    if (p >= end || *p != ':')
+                        return fail(QStringLiteral("missing name separator"));
+                    ++p;
+                    skipWhitespace();
+                    if (!parseValue(object[key]))
+                        return false;
+                    skipWhitespace();
+                    if (p < end && *p == ',') {
+                        ++p;
+                    } else if (p < end && *p == '}') {
+                        ++p;
+                        break;
+                    } else {
+                        return fail(QStringLiteral("missing value separator"));
+                    }
+                }
+            }
+
+            --depth;
+            value = object;
+            return true;
+        }
+
+        static int hexValue(char c)
+        {
+            if (c >= '0' && c <= '9')
+                return c - '0';
+            if (c >= 'a' && c <= 'f')
+                return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F')
+                return c - 'A' + 10;
+            return -1;
+        }
+
+        bool parseHex4(ushort &code)
+        {
+            if (end - p < 4)
+                return fail(QStringLiteral("illegal escape sequence"));
+            code = 0;
+            for (int i = 0; i < 4; ++i) {
+                int h = hexValue(*p++);
+                if (h < 0)
+                    return fail(QStringLiteral("illegal escape sequence"));
+                code = (code << 4) | h;
+            }
+            return true;
+        }
+
+        bool parseString(QString &str)
+        {
+            ++p; // '"'
+            const char *chunk = p;
+            str.clear();
+
+            // Most strings have no escape sequences, they are converted from UTF-8 at once
+            forever {
+                if (p >= end)
+                    return fail(QStringLiteral("unterminated string"));
+
+                char c = *p;
+                if (c == '"') {
+                    str.append(QString::fromUtf8(chunk, p - chunk));
+                    ++p;
+                    return true;
+                } else if (static_cast<uchar>(c) < 0x20) {
+                    return fail(QStringLiteral("illegal character in string"));
+                } else if (c != '\\') {
+                    ++p;
+                    continue;
+                }
+
+                str.append(QString::fromUtf8(chunk, p - chunk));
+                ++p;
+                if (p >= end)
+                    return fail(QStringLiteral("unterminated string"));
+
+                switch (*p++) {
+                case '"':
+                    str.append(QChar::fromLatin1('"'));
+                    break;
+                case '\\':
+                    str.append(QChar::fromLatin1('\\'));
+                    break;
+                case '/':
+                    str.append(QChar::fromLatin1('/'));
+                    break;
+                case 'b':
+                    str.append(QChar::fromLatin1('\b'));
+                    break;
+                case 'f':
+                    str.append(QChar::fromLatin1('\f'));
+                    break;
+                case 'n':
+                    str.append(QChar::fromLatin1('\n'));
+                    break;
+                case 'r':
+                    str.append(QChar::fromLatin1('\r'));
+                    break;
+                case 't':
+                    str.append(QChar::fromLatin1('\t'));
+                    break;
+                case 'u': {
+                    ushort code = 0;
+                    if (!parseHex4(code))
+                        return false;
+                    str.append(QChar(code));
+                    break;
+                }
+                default:
+                    return fail(QStringLiteral("illegal escape sequence"));
+                }
+                chunk = p;
+            }
+        }
+
+        bool parseNumber(QVariant &value)
+        {
+            const char *start = p;
+            bool isInteger = true;
+
+            if (p < end && *p == '-')
+                ++p;
+            if (p >= end || *p < '0' || *p > '9')
+                return fail(QStringLiteral("illegal value"));
+            if (*p == '0')
+                ++p;
+            else {
+                while (p < end && *p >= '0' && *p <= '9')
+                    ++p;
+            }
+            if (p < end && *p == '.') {
+                isInteger = false;
+                ++p;
+                if (p >= end || *p < '0' || *p > '9')
+                    return fail(QStringLiteral("illegal number"));
+                while (p < end && *p >= '0' && *p <= '9')
+                    ++p;
+            }
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                isInteger = false;
+                ++p;
+                if (p < end && (*p == '+' || *p == '-'))
+                    ++p;
+                if (p >= end || *p < '0' || *p > '9')
+                    return fail(QStringLiteral("illegal number"));
+                while (p < end && *p >= '0' && *p <= '9')
+                    ++p;
+            }
+
+            const QByteArray number = QByteArray::fromRawData(start, p - start);
+            bool ok = false;
+
+            // keep integers as int, just like what is put into a packet on the other side
+            if (isInteger) {
+                qlonglong n = number.toLongLong(&ok);
+                if (ok && n >= std::numeric_limits<int>::min() && n <= std::numeric_limits<int>::max()) {
+                    value = static_cast<int>(n);
+                    return true;
+                } else if (ok && n >= 0 && n <= std::numeric_limits<uint>::max()) {
+                    value = static_cast<uint>(n);
+                    return true;
+                }
+            }
+
+            double d = number.toDouble(&ok);
+            if (!ok)
+                return fail(QStringLiteral("illegal number"));
+            value = d;
+            return true;
+        }
+    };
+
+    class JsonWriter
+    {
+    public:
+        explicit JsonWriter(bool isIndented)
+            : indented(isIndented)
+        {
+        }
+
+        void write(const QVariant &value, int indent = 0)
+        {
+            switch (value.userType()) {
+            case QMetaType::UnknownType:
+            case QMetaType::Void:
+            case QMetaType::Nullptr:
+                out.append("null");
+                break;
+            case QMetaType::Bool:
+                out.append(value.toBool() ? "true" : "false");
+                break;
+            case QMetaType::Int:
+            case QMetaType::Short:
+            case QMetaType::Long:
+            case QMetaType::LongLong:
+                out.append(QByteArray::number(value.toLongLong()));
+                break;
+            case QMetaType::UInt:
+            case QMetaType::UShort:
+            case QMetaType::ULong:
+            case QMetaType::ULongLong:
+                out.append(QByteArray::number(value.toULongLong()));
+                break;
+            case QMetaType::Double:
+            case QMetaType::Float:
+                writeDouble(value.toDouble());
+                break;
+            case QMetaType::QString:
+                writeString(value.toString());
+                break;
+            case QMetaType::QStringList:
+            case QMetaType::QVariantList:
+                writeArray(value.toList(), indent);
+                break;
+            case QMetaType::QVariantMap:
+                writeObject(value.toMap(), indent);
+                break;
+            case QMetaType::QVariantHash: {
+                // written in the order of keys, the same as QVariantMap
+                const QVariantHash hash = value.toHash();
+                JsonObject object;
+                for (auto i = hash.cbegin(), e = hash.cend(); i != e; ++i)
+                    object.insert(i.key(), i.value());
+                writeObject(object, indent);
+                break;
+            }
+            default:
+                // the same as what QJsonValue::fromVariant does
+                if (value.canConvert<QString>())
+                    writeString(value.toString());
+                else
+                    out.append("null");
+            }
+        }
+
+        QByteArray out;
+
+    private:
+        bool indented;
+
+        void newLine(int indent)
+        {
+            if (indented) {
+                out.append('\n');
+                out.append(QByteArray(indent * 4, ' '));
+            }
+        }
+
+        void writeDouble(double d)
+        {
+            if (std::isnan(d) || std::isinf(d))
+                out.append("null");
+            else if (d == std::floor(d) && std::fabs(d) < 1e15)
+                out.append(QByteArray::number(static_cast<qlonglong>(d)));
+            else
+                out.append(QByteArray::number(d, 'g', std::numeric_limits<double>::digits10 + 2));
+        }
+
+        void writeString(const QString &str)
+        {
+            const QByteArray utf8 = str.toUtf8();
+            const char *data = utf8.constData();
+            const int length = utf8.length();
+
+            out.reserve(out.length() + length + 2);
+            out.append('"');
+            int chunk = 0;
+            for (int i = 0; i < length; ++i) {
+                uchar c = static_cast<uchar>(data[i]);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                    continue;
+
+                out.append(data + chunk, i - chunk);
+                chunk = i + 1;
+                switch (c) {
+                case '"':
+                    out.append("\\\"");
+                    break;
+                case '\\':
+                    out.append("\\\\");
+                    break;
+                case '\b':
+                    out.append("\\b");
+                    break;
+                case '\f':
+                    out.append("\\f");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\t':
+                    out.append("\\t");
+                    break;
+                default: {
+                    static const char hex[] = "0123456789abcdef";
+                    out.append("\\u00");
+                    out.append(hex[c >> 4]);
+                    out.append(hex[c & 0xf]);
+                }
+                }
+            }
+            out.append(data + chunk, length - chunk);
+            out.append('"');
+        }
+
+        void writeArray(const JsonArray &array, int indent)
+        {
+            out.append('[');
+            if (!array.isEmpty()) {
+                bool first = true;
+                foreach (const QVariant &v, array) {
+                    if (!first)
+                        out.append(',');
+                    first = false;
+                    newLine(indent + 1);
+                    write(v, indent + 1);
+                }
+                newLine(indent);
+            }
+            out.append(']');
+        }
+
+        void writeObject(const JsonObject &object, int indent)
+        {
+            out.append('{');
+            if (!object.isEmpty()) {
+                for (auto i = object.cbegin(), e = object.cend(); i != e; ++i) {
+                    if (i != object.cbegin())
+                        out.append(',');
+                    newLine(indent + 1);
+                    writeString(i.key());
+                    out.append(indented ? ": " : ":");
+                    write(i.value(), indent + 1);
+                }
+                newLine(indent);
+            }
+            out.append('}');
+        }
+    };
+}
+
 JsonDocument::JsonDocument()
     :d_ptr(new JsonDocumentPrivate)
 {
@@ -35,6 +558,39 @@ JsonDocument::JsonDocument()
     d->valid = false;
 }
 
+JsonDocument::JsonDocument(const JsonDocument &other)
+    : d_ptr(other.d_ptr)
+{
+}
+
+JsonDocument::JsonDocument(JsonDocument &&other)
+    : d_ptr(std::move(other.d_ptr))
+{
+    // the moved-from document is left invalid, it shares one empty private instead of allocating its own
+    static const QExplicitlySharedDataPointer<JsonDocumentPrivate> empty([]() {
+        JsonDocumentPrivate *d = new JsonDocumentPrivate;
+        d->valid = false;
+        return d;
+    }());
+    other.d_ptr = empty;
+}
+
+JsonDocument::~JsonDocument()
+{
+}
+
+JsonDocument &JsonDocument::operator=(const JsonDocument &other)
+{
+    d_ptr = other.d_ptr;
+    return *this;
+}
+
+JsonDocument &JsonDocument::operator=(JsonDocument &&other)
+{
+    d_ptr.swap(other.d_ptr);
+    return *this;
+}
+
 JsonDocument::JsonDocument(const QVariant &var)
     : d_ptr(new JsonDocumentPrivate)
 {
@@ -62,7 +618,24 @@ JsonDocument::JsonDocument(const JsonObject &object)
 JsonDocument JsonDocument::fromFilePath(const QString &path, bool allowComment)
 {
     QFile file(path);
-    file.open(QFile::ReadOnly);
+    if (!file.open(QFile::ReadOnly)) {
+        JsonDocument doc;
+        doc.d_func()->error = file.errorString();
+        return doc;
+    }
+
+    // The parser never keeps references to its input, so a mapped file is parsed in place without copying it.
+    // Files which can't be mapped (e.g. compressed resources) are read as usual.
+    qint64 size = file.size();
+    if (size > 0 && size <= std::numeric_limits<int>::max()) {
+        uchar *data = file.map(0, size);
+        if (data != nullptr) {
+            JsonDocument doc = fromJson(QByteArray::fromRawData(reinterpret_cast<const char *>(data), static_cast<int>(size)), allowComment);
+            file.unmap(data);
+            return doc;
+        }
+    }
+
     return fromJson(file.readAll(), allowComment);
 }
 
@@ -281,72 +854,27 @@ bool JsonUtils::tryParse(const QVariant &arg, QColor &color)
     return true;
 }
 #endif
-QByteArray clearComment(const QByteArray &src)
-{
-    QByteArray result(src);
-    int max = result.size() - 1;
-    for (int i = 0; i < max; i++) {
-        switch (result.at(i)) {
-            case '/':
-                if (result.at(i + 1) == '*') { // multi-line comment
-                    int offset = i;
-                    i++;
-                    while (i < max && (result.at(i) != '*' || result.at(i + 1) != '/')) {
-                        i++;
-                    }
-
-                    int length = i + 2 - offset;
-                    result.remove(offset, length);
-                    i = offset - 1;
-                    max -= length;
-
-                } else if (result.at(i + 1) == '/') { // single-line comment
-                    int offset = i;
-                    i++;
-                    while (i < max + 1 && result.at(i) != '\n') {
-                        i++;
-                    }
-
-                    int length = i + 1 - offset;
-                    result.remove(offset, length);
-                    i = offset - 1;
-                    max -= length;
-                }
-                break;
-            case '"': // string
-                while (i < max + 1 && result.at(i) != '"') {
-                    if (result.at(i) == '\\') {
-                        i += 2;
-                    } else {
-                        i++;
-                    }
-                }
-                break;
-            default:;
-        }
-    }
-    return result;
-}
 
 QByteArray JsonDocument::toJson(bool isIndented) const
 {
     Q_D(const JsonDocument);
-    QJsonDocument doc = QJsonDocument::fromVariant(d->value);
-    return doc.toJson(isIndented ? QJsonDocument::Indented : QJsonDocument::Compact);
+    JsonWriter writer(isIndented);
+    writer.write(d->value);
+    if (isIndented)
+        writer.out.append('\n');
+    return writer.out;
 }
 
 JsonDocument JsonDocument::fromJson(const QByteArray &json, bool allowComment)
 {
-    QJsonParseError error;
-    QJsonDocument jsondoc = QJsonDocument::fromJson(allowComment ? clearComment(json) : json, &error);
+    JsonReader reader(json.constData(), json.length(), allowComment);
 
     JsonDocument doc;
-    if (error.error == QJsonParseError::NoError) {
-        doc.d_func()->value = jsondoc.toVariant();
-        doc.d_func()->valid = true;
-    } else {
-        doc.d_func()->valid = false;
-        doc.d_func()->error = error.errorString();
+    JsonDocumentPrivate *d = doc.d_func();
+    d->valid = reader.parse(d->value);
+    if (!d->valid) {
+        d->value.clear();
+        d->error = reader.error;
     }
     return doc;
 }
@@ -34,6 +34,11 @@ class LIBQSGSCORE_EXPORT JsonDocument
 public:
     JsonDocument();
     JsonDocument(const QVariant &var);
+    JsonDocument(const JsonDocument &other);
+    JsonDocument(JsonDocument &&other);
+    ~JsonDocument();
+    JsonDocument &operator=(const JsonDocument &other);
+    JsonDocument &operator=(JsonDocument &&other);
 
     JsonDocument(const JsonArray &array);
     JsonDocument(const JsonObject &object);
@@ -52,8 +57,9 @@ public:
     const QString errorString() const;
 
 protected:
+    // documents are immutable once created, so copies simply share the private object
     Q_DECLARE_PRIVATE(JsonDocument)
-    JsonDocumentPrivate *d_ptr;
+    QExplicitlySharedDataPointer<JsonDocumentPrivate> d_ptr;
 };
 
 #if 0
@@ -19,13 +19,42 @@
     *********************************************************************/
 
 #include "nativesocket.h"
+#include "protocol.h"
 #include "settings.h"
 
+namespace {
+    const int frameHeaderSize = 4;
+    // keep it the same as Packet::S_MAX_PACKET_SIZE, a longer message can't be parsed anyway
+    const qint64 maxMessageSize = 65535;
+    // the outbox is written at once when it grows over this size, instead of waiting for the event loop
+    const int outboxFlushThreshold = 16384;
+
+#ifndef QT_NO_DEBUG
+    // binary packets are dumped in hex, they are not printable and may contain '\0'
+    void debugPrint(const char *prefix, const QByteArray &message)
+    {
+        if (QSanProtocol::Packet::isBinary(message))
+            printf("%s[hex] %s\n", prefix, message.toHex().constData());
+        else
+            printf("%s%s\n", prefix, message.trimmed().constData());
+    }
+#endif
+}
+
 class NativeServerSocketPrivate
 {
 public:
     QTcpServer *server;
     QUdpSocket *daemon;
+
+    // accepted connections are distributed among these threads, which do all the reading, writing and framing
+    QList<QThread *> ioThreads;
+    int nextIoThread;
+
+    // the connections living in the I/O threads, they are deleted there before the threads stop.
+    // A connection removes itself when it is deleted, which happens in its own thread
+    QMutex connectionsMutex;
+    QSet<NativeClientSocket *> connections;
 };
 
 NativeServerSocket::NativeServerSocket()
@@ -34,13 +63,56 @@ NativeServerSocket::NativeServerSocket()
     Q_D(NativeServerSocket);
     d->server = new QTcpServer(this);
     d->daemon = nullptr;
+    d->nextIoThread = 0;
     connect(d->server, &QTcpServer::newConnection, this, &NativeServerSocket::processNewConnection);
 }
 
+NativeServerSocket::~NativeServerSocket()
+{
+    Q_D(NativeServerSocket);
+    {
+        // deleteLater() is thread-safe, it posts the deletion to the thread of the connection.
+        // A QThread deletes the objects posted this way when it finishes even if its event loop has quit,
+        // so no connection outlives its thread, and no QTcpSocket is touched from another thread.
+        QMutexLocker locker(&d->connectionsMutex);
+        Q_UNUSED(locker);
+        foreach (NativeClientSocket *connection, d->connections) {
+            connection->disconnect(this);
+            connection->deleteLater();
+        }
+        d->connections.clear();
+    }
+
+    foreach (QThread *thread, d->ioThreads)
+        thread->quit();
+    foreach (QThread *thread, d->ioThreads) {
+        thread->wait();
+        delete thread;
+    }
+
+    delete d;
+}
+
 bool NativeServerSocket::listen()
 {
     Q_D(NativeServerSocket);
-    return d->server->listen(QHostAddress::Any, QSgsCoreSettings::serverPort());
+    if (!d->server->listen(QHostAddress::Any, QSgsCoreSettings::serverPort()))
+        return false;
+
+    if (d->ioThreads.isEmpty()) {
+        int n = QSgsCoreSettings::ioThreadCount();
+        if (n <= 0)
+            n = QThread::idealThreadCount();
+
+        for (int i = 0; i < n; ++i) {
+            QThread *thread = new QThread;
+            thread->setObjectName(QStringLiteral("NativeSocketIO-%1").arg(i));
+            thread->start();
+            d->ioThreads << thread;
+        }
+    }
+
+    return true;
 }
 
 void NativeServerSocket::daemonize()
@@ -69,9 +141,31 @@ void NativeServerSocket::processNewDatagram()
 void NativeServerSocket::processNewConnection()
 {
     Q_D(NativeServerSocket);
-    QTcpSocket *socket = d->server->nextPendingConnection();
-    NativeClientSocket *connection = new NativeClientSocket(socket);
-    emit new_connection(connection);
+    while (d->server->hasPendingConnections()) {
+        QTcpSocket *socket = d->server->nextPendingConnection();
+        NativeClientSocket *connection = new NativeClientSocket(socket);
+
+        // The receivers connect to the signals of the connection here, so it is moved to its I/O thread only after that,
+        // otherwise messages arriving in between would get lost.
+        // Signals emitted from the I/O thread reach the receivers in other threads through queued connections.
+        emit new_connection(connection);
+
+        if (!d->ioThreads.isEmpty()) {
+            {
+                QMutexLocker locker(&d->connectionsMutex);
+                Q_UNUSED(locker);
+                d->connections << connection;
+            }
+            connect(connection, &QObject::destroyed, this, [d, connection]() {
+                QMutexLocker locker(&d->connectionsMutex);
+                Q_UNUSED(locker);
+                d->connections.remove(connection);
+            }, Qt::DirectConnection);
+
+            connection->moveToThread(d->ioThreads.at(d->nextIoThread));
+            d->nextIoThread = (d->nextIoThread + 1) % d->ioThreads.length();
+        }
+    }
 }
 
 // ---------------------------------
@@ -80,6 +174,26 @@ class NativeClientSocketPrivate
 {
 public:
     QTcpSocket *socket;
+    // only written in the thread of the socket, and may be read from any thread
+    QAtomicInt framing;
+    // set by the thread which handles the negotiation, and read by the threads encoding packets
+    QAtomicInt protocolFeatures;
+
+    // QTcpSocket can't be queried from other threads, so its state and peer are mirrored here
+    QAtomicInt state;
+    mutable QMutex peerMutex;
+    QString peerName;
+    QString peerAddress;
+    ushort peerPort;
+
+    // messages sent during one turn of the event loop, written to the socket together
+    QByteArray outbox;
+    bool flushScheduled;
+
+    // written in the thread of the socket, and may be read from any thread
+    mutable QMutex statisticsMutex;
+    ClientSocket::OutboundStatistics statistics;
+    bool congested;
 };
 
 NativeClientSocket::NativeClientSocket()
@@ -102,10 +216,56 @@ NativeClientSocket::NativeClientSocket(QTcpSocket *socket)
 void NativeClientSocket::init()
 {
     Q_D(NativeClientSocket);
+    d->framing.store(LineFraming);
+    d->protocolFeatures.store(QSanProtocol::S_FEATURE_NONE);
+    d->state.store(d->socket->state());
+    d->peerPort = 0;
+    d->flushScheduled = false;
+    d->statistics.pendingBytes = 0;
+    d->statistics.peakPendingBytes = 0;
+    d->statistics.sentMessages = 0;
+    d->statistics.droppedMessages = 0;
+    d->statistics.congestions = 0;
+    d->congested = false;
+
+    // Never buffer more than one complete message, so that a peer sending garbage without a newline can't grow our memory.
+    // QAbstractSocket stops reading from the OS when the buffer is full, and continues after getMessage() consumed it.
+    d->socket->setReadBufferSize(frameHeaderSize + maxMessageSize + 1);
+
     connect(d->socket, &QTcpSocket::disconnected, this, &NativeClientSocket::disconnected);
     connect(d->socket, &QTcpSocket::readyRead, this, &NativeClientSocket::getMessage);
     connect(d->socket, (void (QTcpSocket::*)(QAbstractSocket::SocketError))(&QTcpSocket::error), this, &NativeClientSocket::raiseError);
+    connect(d->socket, &QTcpSocket::connected, this, &NativeClientSocket::applySocketOptions);
+    connect(d->socket, &QTcpSocket::bytesWritten, this, &NativeClientSocket::updatePendingBytes);
+    connect(d->socket, &QTcpSocket::stateChanged, this, &NativeClientSocket::updateState);
     connect(d->socket, &QTcpSocket::connected, this, &NativeClientSocket::connected);
+
+    // an accepted socket is connected already
+    if (d->socket->state() == QAbstractSocket::ConnectedState)
+        applySocketOptions();
+}
+
+void NativeClientSocket::updateState(QAbstractSocket::SocketState state)
+{
+    Q_D(NativeClientSocket);
+    d->state.store(state);
+}
+
+void NativeClientSocket::applySocketOptions()
+{
+    Q_D(NativeClientSocket);
+    {
+        QMutexLocker locker(&d->peerMutex);
+        Q_UNUSED(locker);
+        d->peerAddress = d->socket->peerAddress().toString();
+        d->peerPort = d->socket->peerPort();
+        d->peerName = d->socket->peerName();
+        if (d->peerName.isEmpty())
+            d->peerName = QStringLiteral("%1:%2").arg(d->peerAddress).arg(d->peerPort);
+    }
+
+    d->socket->setSocketOption(QAbstractSocket::LowDelayOption, QSgsCoreSettings::tcpNoDelay() ? 1 : 0);
+    d->socket->setSocketOption(QAbstractSocket::KeepAliveOption, QSgsCoreSettings::tcpKeepAlive() ? 1 : 0);
 }
 
 void NativeClientSocket::connectToHost()
@@ -143,63 +303,255 @@ void NativeClientSocket::connectToHost(const QHostAddress &address, ushort port)
 void NativeClientSocket::getMessage()
 {
     Q_D(NativeClientSocket);
-    while (d->socket->canReadLine()) {
-        QByteArray msg = d->socket->readLine();
+    forever {
+        char header[frameHeaderSize];
+        if (d->socket->peek(header, 1) != 1)
+            return;
+
+        QByteArray msg;
+        if (header[0] == '\0') {
+            // length-prefixed frame. The first byte of a JSON line is never '\0', and neither is it for a frame longer than 16M
+            if (d->socket->peek(header, frameHeaderSize) != frameHeaderSize)
+                return;
+
+            quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(header));
+            if (length > maxMessageSize) {
+                rejectOversizedMessage();
+                return;
+            }
+
+            if (d->socket->bytesAvailable() < frameHeaderSize + length)
+                return;
+
+            d->socket->read(header, frameHeaderSize);
+            msg = d->socket->read(length);
+        } else if (d->socket->canReadLine()) {
+            msg = d->socket->readLine();
+        } else {
+            if (d->socket->bytesAvailable() > maxMessageSize)
+                rejectOversizedMessage();
+            return;
+        }
+
 #ifndef QT_NO_DEBUG
-        printf("recv: %s", msg.constData());
+        debugPrint("recv: ", msg);
 #endif
         emit message_got(msg);
     }
 }
 
+void NativeClientSocket::rejectOversizedMessage()
+{
+    Q_D(NativeClientSocket);
+    emit error_message(tr("Message from %1 is too long, connection aborted").arg(peerName()));
+    d->socket->abort();
+}
+
 void NativeClientSocket::disconnectFromHost()
 {
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "disconnectFromHost", Qt::QueuedConnection);
+        return;
+    }
+
+    flushOutbox();
+
     Q_D(NativeClientSocket);
     d->socket->disconnectFromHost();
 }
 
 void NativeClientSocket::send(const QByteArray &message)
+{
+    // QTcpSocket can only be used in its own thread.
+    // Queued calls keep their order, and the message is implicitly shared rather than copied.
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "send", Qt::QueuedConnection, Q_ARG(QByteArray, message));
+        return;
+    }
+
+    enqueue(message, false);
+}
+
+void NativeClientSocket::sendDroppable(const QByteArray &message)
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "sendDroppable", Qt::QueuedConnection, Q_ARG(QByteArray, message));
+        return;
+    }
+
+    enqueue(message, true);
+}
+
+void NativeClientSocket::enqueue(const QByteArray &message, bool droppable)
 {
     Q_D(NativeClientSocket);
     if (message.isEmpty())
         return;
-    d->socket->write(message);
-    if (!message.endsWith('\n')) {
-        d->socket->write("\n");
+
+    if (droppable && d->congested) {
+        QMutexLocker locker(&d->statisticsMutex);
+        Q_UNUSED(locker);
+        ++d->statistics.droppedMessages;
+        return;
+    }
+
+    if (d->framing.load() == LengthPrefixedFraming) {
+        if (message.length() > maxMessageSize) {
+            qWarning("%s", qPrintable(tr("Message is too long to be sent, dropped")));
+            return;
+        }
+        uchar header[frameHeaderSize];
+        qToBigEndian<quint32>(message.length(), header);
+        d->outbox.append(reinterpret_cast<const char *>(header), frameHeaderSize);
+        d->outbox.append(message);
+    } else {
+        d->outbox.append(message);
+        if (!message.endsWith('\n')) {
+            d->outbox.append('\n');
+        }
     }
 
 #ifndef QT_NO_DEBUG
-    printf(": %s\n", message.constData());
+    debugPrint(": ", message);
 #endif
+
+    {
+        QMutexLocker locker(&d->statisticsMutex);
+        Q_UNUSED(locker);
+        ++d->statistics.sentMessages;
+    }
+    updatePendingBytes();
+    if (d->socket->state() == QAbstractSocket::UnconnectedState)
+        return; // aborted for exceeding the limit
+
+    // A burst of messages (e.g. a lot of notifications in one event) is written with one syscall after the current event is handled.
+    // A single message is written as soon as the control returns to the event loop, so it gets no more latency.
+    if (d->outbox.length() >= outboxFlushThreshold) {
+        flushOutbox();
+    } else if (!d->flushScheduled) {
+        d->flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushOutbox", Qt::QueuedConnection);
+    }
+}
+
+void NativeClientSocket::updatePendingBytes()
+{
+    Q_D(NativeClientSocket);
+    qint64 pending = d->outbox.length() + d->socket->bytesToWrite();
+
+    bool congestionChanged = false;
+    {
+        QMutexLocker locker(&d->statisticsMutex);
+        Q_UNUSED(locker);
+        d->statistics.pendingBytes = pending;
+        d->statistics.peakPendingBytes = qMax(d->statistics.peakPendingBytes, pending);
+
+        if (!d->congested && pending > QSgsCoreSettings::outboundHighWatermark()) {
+            d->congested = true;
+            ++d->statistics.congestions;
+            congestionChanged = true;
+        } else if (d->congested && pending <= QSgsCoreSettings::outboundLowWatermark()) {
+            d->congested = false;
+            congestionChanged = true;
+        }
+    }
+
+    if (congestionChanged)
+        emit congestion_changed(d->congested);
+
+    // The peer has stopped reading. Aborting the connection makes the owner of the socket handle it as a disconnection,
+    // e.g. the player goes offline and is trusted to the AI, instead of letting the queue grow forever.
+    if (pending > QSgsCoreSettings::outboundLimit()) {
+        emit error_message(tr("%1 doesn't read its messages, connection aborted").arg(peerName()));
+        d->outbox.clear();
+        d->socket->abort();
+    }
+}
+
+void NativeClientSocket::flushOutbox()
+{
+    Q_D(NativeClientSocket);
+    d->flushScheduled = false;
+    if (d->outbox.isEmpty())
+        return;
+
+    d->socket->write(d->outbox);
+    d->outbox.clear();
     d->socket->flush();
+    updatePendingBytes();
 }
 
 bool NativeClientSocket::isConnected() const
 {
     Q_D(const NativeClientSocket);
-    return d->socket->state() == QTcpSocket::ConnectedState;
+    return d->state.load() == QAbstractSocket::ConnectedState;
 }
 
 QString NativeClientSocket::peerName() const
 {
     Q_D(const NativeClientSocket);
-    QString peer_name = d->socket->peerName();
-    if (peer_name.isEmpty())
-        peer_name = QStringLiteral("%1:%2").arg(d->socket->peerAddress().toString()).arg(d->socket->peerPort());
-
-    return peer_name;
+    QMutexLocker locker(&d->peerMutex);
+    Q_UNUSED(locker);
+    return d->peerName;
 }
 
 QString NativeClientSocket::peerAddress() const
 {
     Q_D(const NativeClientSocket);
-    return d->socket->peerAddress().toString();
+    QMutexLocker locker(&d->peerMutex);
+    Q_UNUSED(locker);
+    return d->peerAddress;
 }
 
 ushort NativeClientSocket::peerPort() const
 {
     Q_D(const NativeClientSocket);
-    return d->socket->peerPort();
+    QMutexLocker locker(&d->peerMutex);
+    Q_UNUSED(locker);
+    return d->peerPort;
+}
+
+void NativeClientSocket::setFraming(Framing framing)
+{
+    // Queued like send(), so the messages sent before keep the old framing and the ones sent after get the new one.
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "applyFraming", Qt::QueuedConnection, Q_ARG(int, framing));
+        return;
+    }
+
+    applyFraming(framing);
+}
+
+void NativeClientSocket::applyFraming(int framing)
+{
+    Q_D(NativeClientSocket);
+    d->framing.store(framing);
+}
+
+ClientSocket::Framing NativeClientSocket::framing() const
+{
+    Q_D(const NativeClientSocket);
+    return static_cast<Framing>(d->framing.load());
+}
+
+void NativeClientSocket::setProtocolFeatures(int features)
+{
+    Q_D(NativeClientSocket);
+    d->protocolFeatures.store(features);
+}
+
+int NativeClientSocket::protocolFeatures() const
+{
+    Q_D(const NativeClientSocket);
+    return d->protocolFeatures.load();
+}
+
+ClientSocket::OutboundStatistics NativeClientSocket::outboundStatistics() const
+{
+    Q_D(const NativeClientSocket);
+    QMutexLocker locker(&d->statisticsMutex);
+    Q_UNUSED(locker);
+    return d->statistics;
 }
 
 void NativeClientSocket::raiseError(QAbstractSocket::SocketError socket_error)
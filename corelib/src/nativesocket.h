@@ -36,6 +36,7 @@ class LIBQSGSCORE_EXPORT NativeServerSocket : public ServerSocket
 
 public:
     NativeServerSocket();
+    ~NativeServerSocket();
 
     bool listen() final override;
     void daemonize() final override;
@@ -62,22 +63,36 @@ public:
     void connectToHost() final override;
     void connectToHost(const QHostAddress &address) final override;
     void connectToHost(const QHostAddress &address, ushort port) final override;
-    void disconnectFromHost() final override;
-    void send(const QByteArray &message) final override;
+    // these functions can be called from any thread, they are forwarded to the thread the socket lives in
+    Q_INVOKABLE void disconnectFromHost() final override;
+    Q_INVOKABLE void send(const QByteArray &message) final override;
+    Q_INVOKABLE void sendDroppable(const QByteArray &message) final override;
     bool isConnected() const final override;
     QString peerName() const final override;
     QString peerAddress() const final override;
     ushort peerPort() const final override;
+    void setFraming(Framing framing) final override;
+    Framing framing() const final override;
+    void setProtocolFeatures(int features) final override;
+    int protocolFeatures() const final override;
+    OutboundStatistics outboundStatistics() const final override;
 
 private slots:
     void getMessage();
     void raiseError(QAbstractSocket::SocketError socket_error);
+    void applySocketOptions();
+    void flushOutbox();
+    void updatePendingBytes();
+    void updateState(QAbstractSocket::SocketState state);
+    void applyFraming(int framing);
 
 private:
     Q_DECLARE_PRIVATE(NativeClientSocket)
     NativeClientSocketPrivate *d_ptr;
 
     void init();
+    void rejectOversizedMessage();
+    void enqueue(const QByteArray &message, bool droppable);
 };
 
 #endif
@@ -21,14 +21,278 @@
 #include "protocol.h"
 #include "json.h"
 
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+
 using namespace QSanProtocol;
 
-unsigned int QSanProtocol::Packet::m_globalSerialSequence = 0;
+QAtomicInteger<unsigned int> QSanProtocol::Packet::m_globalSerialSequence(0);
 const int QSanProtocol::Packet::S_MAX_PACKET_SIZE = 65535;
+// a JSON packet always starts with '[', so the first byte tells which form a packet is in
+const char QSanProtocol::Packet::S_BINARY_PACKET_MARK = '\x01';
 const char *QSanProtocol::S_PLAYER_SELF_REFERENCE_ID = "MG_SELF";
 
 const int QSanProtocol::S_ALL_ALIVE_PLAYERS = 0;
 
+const int QSanProtocol::S_SUPPORTED_FEATURES = S_FEATURE_LENGTH_PREFIXED_FRAME | S_FEATURE_BINARY_CODEC | S_FEATURE_ROOM_SNAPSHOT | S_FEATURE_SESSION_RESUME;
+
+// increase it when the content of a snapshot changes in an incompatible way
+const int QSanProtocol::S_ROOM_SNAPSHOT_VERSION = 1;
+
+bool QSanProtocol::isCosmeticCommand(CommandType command)
+{
+    switch (command) {
+    case S_COMMAND_ANIMATE:
+    case S_COMMAND_SET_EMOTION:
+    case S_COMMAND_SPEAK:
+    case S_COMMAND_MOVE_FOCUS:
+    case S_COMMAND_MIRROR_GUANXING_STEP:
+    case S_COMMAND_MIRROR_MOVECARDS_STEP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The binary form of a packet is:
+//     S_BINARY_PACKET_MARK, globalSerial, localSerial, packetDescription, command as varints, then the optional message body
+// Every value of the message body starts with one of the following tags.
+// Integers are LEB128 varints, so card id lists are mostly 1 byte per card.
+namespace {
+    enum BinaryTag
+    {
+        TagNull,
+        TagFalse,
+        TagTrue,
+        TagPositive, // varint
+        TagNegative, // varint of (-1 - value)
+        TagDouble, // 8 bytes, little endian
+        TagString, // varint length, then UTF-8
+        TagArray, // varint count, then the elements
+        TagObject // varint count, then (varint length, UTF-8 key, value) pairs
+    };
+
+    const int maxBinaryDepth = 64;
+
+    void writeVarint(QByteArray &out, quint64 value)
+    {
+        while (value >= 0x80) {
+            out.append(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.append(static_cast<char>(value));
+    }
+
+    bool readVarint(const char *&p, const char *end, quint64 &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            uchar c = static_cast<uchar>(*p++);
+            value |= static_cast<quint64>(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    void writeString(QByteArray &out, const QString &str)
+    {
+        const QByteArray utf8 = str.toUtf8();
+        writeVarint(out, utf8.length());
+        out.append(utf8);
+    }
+
+    bool readString(const char *&p, const char *end, QString &str)
+    {
+        quint64 length = 0;
+        if (!readVarint(p, end, length) || length > static_cast<quint64>(end - p))
+            return false;
+        str = QString::fromUtf8(p, static_cast<int>(length));
+        p += length;
+        return true;
+    }
+
+    void writeValue(QByteArray &out, const QVariant &value)
+    {
+        switch (value.userType()) {
+        case QMetaType::UnknownType:
+        case QMetaType::Void:
+        case QMetaType::Nullptr:
+            out.append(static_cast<char>(TagNull));
+            break;
+        case QMetaType::Bool:
+            out.append(static_cast<char>(value.toBool() ? TagTrue : TagFalse));
+            break;
+        case QMetaType::Int:
+        case QMetaType::Short:
+        case QMetaType::Long:
+        case QMetaType::LongLong: {
+            qint64 n = value.toLongLong();
+            if (n >= 0) {
+                out.append(static_cast<char>(TagPositive));
+                writeVarint(out, static_cast<quint64>(n));
+            } else {
+                out.append(static_cast<char>(TagNegative));
+                writeVarint(out, static_cast<quint64>(-1 - n));
+            }
+            break;
+        }
+        case QMetaType::UInt:
+        case QMetaType::UShort:
+        case QMetaType::ULong:
+        case QMetaType::ULongLong:
+            out.append(static_cast<char>(TagPositive));
+            writeVarint(out, value.toULongLong());
+            break;
+        case QMetaType::Double:
+        case QMetaType::Float: {
+            // JSON numbers are parsed as double, so integral values are written in the compact form
+            double d = value.toDouble();
+            if (d >= std::numeric_limits<int>::min() && d <= std::numeric_limits<int>::max() && d == static_cast<double>(static_cast<int>(d))) {
+                writeValue(out, static_cast<int>(d));
+            } else {
+                quint64 bits;
+                memcpy(&bits, &d, sizeof(bits));
+                uchar bytes[8];
+                qToLittleEndian<quint64>(bits, bytes);
+                out.append(static_cast<char>(TagDouble));
+                out.append(reinterpret_cast<const char *>(bytes), 8);
+            }
+            break;
+        }
+        case QMetaType::QStringList:
+        case QMetaType::QVariantList: {
+            const QVariantList list = value.toList();
+            out.append(static_cast<char>(TagArray));
+            writeVarint(out, list.length());
+            foreach (const QVariant &v, list)
+                writeValue(out, v);
+            break;
+        }
+        case QMetaType::QVariantMap: {
+            const QVariantMap map = value.toMap();
+            out.append(static_cast<char>(TagObject));
+            writeVarint(out, map.size());
+            for (auto i = map.cbegin(), e = map.cend(); i != e; ++i) {
+                writeString(out, i.key());
+                writeValue(out, i.value());
+            }
+            break;
+        }
+        case QMetaType::QVariantHash: {
+            const QVariantHash hash = value.toHash();
+            out.append(static_cast<char>(TagObject));
+            writeVarint(out, hash.size());
+            for (auto i = hash.cbegin(), e = hash.cend(); i != e; ++i) {
+                writeString(out, i.key());
+                writeValue(out, i.value());
+            }
+            break;
+        }
+        default:
+            // the same as what QJsonValue::fromVariant does
+            if (value.canConvert<QString>()) {
+                out.append(static_cast<char>(TagString));
+                writeString(out, value.toString());
+            } else
+                out.append(static_cast<char>(TagNull));
+        }
+    }
+
+    bool readValue(const char *&p, const char *end, QVariant &value, int depth = 0)
+    {
+        if (p >= end || depth > maxBinaryDepth)
+            return false;
+
+        switch (static_cast<BinaryTag>(*p++)) {
+        case TagNull:
+            value = QVariant();
+            return true;
+        case TagFalse:
+            value = false;
+            return true;
+        case TagTrue:
+            value = true;
+            return true;
+        case TagPositive: {
+            quint64 n = 0;
+            if (!readVarint(p, end, n))
+                return false;
+            if (n <= static_cast<quint64>(std::numeric_limits<int>::max()))
+                value = static_cast<int>(n);
+            else if (n <= std::numeric_limits<uint>::max())
+                value = static_cast<uint>(n);
+            else
+                value = n;
+            return true;
+        }
+        case TagNegative: {
+            quint64 n = 0;
+            if (!readVarint(p, end, n) || n > static_cast<quint64>(std::numeric_limits<qint64>::max()))
+                return false;
+            qint64 v = -1 - static_cast<qint64>(n);
+            if (v >= std::numeric_limits<int>::min())
+                value = static_cast<int>(v);
+            else
+                value = v;
+            return true;
+        }
+        case TagDouble: {
+            if (end - p < 8)
+                return false;
+            quint64 bits = qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(p));
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            value = d;
+            p += 8;
+            return true;
+        }
+        case TagString: {
+            QString str;
+            if (!readString(p, end, str))
+                return false;
+            value = str;
+            return true;
+        }
+        case TagArray: {
+            quint64 count = 0;
+            // every element takes at least one byte
+            if (!readVarint(p, end, count) || count > static_cast<quint64>(end - p))
+                return false;
+            QVariantList list;
+            list.reserve(static_cast<int>(count));
+            for (quint64 i = 0; i < count; ++i) {
+                QVariant v;
+                if (!readValue(p, end, v, depth + 1))
+                    return false;
+                list << v;
+            }
+            value = list;
+            return true;
+        }
+        case TagObject: {
+            quint64 count = 0;
+            if (!readVarint(p, end, count) || count > static_cast<quint64>(end - p))
+                return false;
+            QVariantMap map;
+            for (quint64 i = 0; i < count; ++i) {
+                QString key;
+                QVariant v;
+                if (!readString(p, end, key) || !readValue(p, end, v, depth + 1))
+                    return false;
+                map[key] = v;
+            }
+            value = map;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+}
+
 bool QSanProtocol::Countdown::tryParse(const QVariant &var)
 {
     if (!var.canConvert<JsonArray>())
@@ -83,7 +347,8 @@ QSanProtocol::Packet::Packet(int packetDescription, CommandType command)
 
 unsigned int QSanProtocol::Packet::createGlobalSerial()
 {
-    globalSerial = ++m_globalSerialSequence;
+    // packets are created in all the room threads
+    globalSerial = m_globalSerialSequence.fetchAndAddOrdered(1) + 1;
     return globalSerial;
 }
 
@@ -93,6 +358,9 @@ bool QSanProtocol::Packet::parse(const QByteArray &raw)
         return false;
     }
 
+    if (isBinary(raw))
+        return parseBinary(raw);
+
     JsonDocument doc = JsonDocument::fromJson(raw);
     JsonArray result = doc.array();
 
@@ -129,6 +397,59 @@ QByteArray QSanProtocol::Packet::toJson() const
     return msg;
 }
 
+bool QSanProtocol::Packet::parseBinary(const QByteArray &raw)
+{
+    const char *p = raw.constData() + 1;
+    const char *end = raw.constData() + raw.length();
+
+    quint64 header[4];
+    for (int i = 0; i < 4; ++i) {
+        if (!readVarint(p, end, header[i]) || header[i] > std::numeric_limits<uint>::max())
+            return false;
+    }
+
+    QVariant body;
+    if (p < end && (!readValue(p, end, body) || p != end))
+        return false;
+
+    globalSerial = static_cast<unsigned int>(header[0]);
+    localSerial = static_cast<unsigned int>(header[1]);
+    m_packetDescription = static_cast<PacketDescription>(header[2]);
+    m_command = static_cast<CommandType>(header[3]);
+    m_messageBody = body;
+    return true;
+}
+
+QByteArray QSanProtocol::Packet::toBinary() const
+{
+    QByteArray msg;
+    msg.append(S_BINARY_PACKET_MARK);
+    writeVarint(msg, globalSerial);
+    writeVarint(msg, localSerial);
+    writeVarint(msg, m_packetDescription);
+    writeVarint(msg, m_command);
+    if (!m_messageBody.isNull())
+        writeValue(msg, m_messageBody);
+
+    if (msg.length() > S_MAX_PACKET_SIZE)
+        return QByteArray();
+
+    return msg;
+}
+
+QByteArray QSanProtocol::Packet::toByteArray(int features) const
+{
+    if (features & S_FEATURE_BINARY_CODEC)
+        return toBinary();
+
+    return toJson();
+}
+
+bool QSanProtocol::Packet::isBinary(const QByteArray &raw)
+{
+    return !raw.isEmpty() && raw.at(0) == S_BINARY_PACKET_MARK;
+}
+
 QString QSanProtocol::Packet::toString() const
 {
     return QString::fromUtf8(toJson());
@@ -158,3 +479,23 @@ CommandType Packet::commandType() const
 {
     return m_command;
 }
+
+BroadcastPacket::BroadcastPacket(const Packet &packet)
+    : m_packet(packet)
+{
+    if (m_packet.globalSerial == 0)
+        m_packet.createGlobalSerial();
+}
+
+const QByteArray &BroadcastPacket::encoded(int features)
+{
+    if (features & S_FEATURE_BINARY_CODEC) {
+        if (m_binary.isEmpty())
+            m_binary = m_packet.toBinary();
+        return m_binary;
+    }
+
+    if (m_json.isEmpty())
+        m_json = m_packet.toJson();
+    return m_json;
+}
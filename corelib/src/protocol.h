@@ -50,6 +50,23 @@ enum PacketDescription
     S_DESC_DUMMY
 };
 
+// Optional protocol features, negotiated per connection at S_COMMAND_CHECK_VERSION:
+// 1. the server notifies S_COMMAND_CHECK_VERSION with its version string, just as before,
+//    then S_COMMAND_PROTOCOL_FEATURES with the features it supports
+// 2. a client which knows about these features notifies S_COMMAND_CHECK_VERSION back with [version, features it supports],
+//    only after receiving S_COMMAND_PROTOCOL_FEATURES, since a legacy server rejects anything but a signup
+// 3. the server notifies S_COMMAND_CHECK_VERSION with [version, accepted features], then sends everything using them
+// 4. the client sends everything using the accepted features after receiving 3.
+// Legacy clients never do 2, so they keep talking to us with newline-delimited JSON, and legacy servers never get 2.
+enum ProtocolFeature
+{
+    S_FEATURE_NONE = 0x0,
+    S_FEATURE_LENGTH_PREFIXED_FRAME = 0x1,
+    S_FEATURE_BINARY_CODEC = 0x2, // needs S_FEATURE_LENGTH_PREFIXED_FRAME, a binary packet may contain '\n'
+    S_FEATURE_ROOM_SNAPSHOT = 0x4, // the room state is sent in one S_COMMAND_ROOM_SNAPSHOT at reconnection
+    S_FEATURE_SESSION_RESUME = 0x8 // a reconnecting client signs up with the last globalSerial it received, and gets only the packets it missed
+};
+
 enum ProcessInstanceType
 {
     S_SERVER_INSTANCE,
@@ -168,7 +185,9 @@ enum CommandType
     S_COMMAND_CHANGE_SKIN,
     S_COMMAND_SKILL_MOVECARDS,
     S_COMMAND_MIRROR_MOVECARDS_STEP,
-    S_COMMAND_SET_VISIBLE_CARDS
+    S_COMMAND_SET_VISIBLE_CARDS,
+    S_COMMAND_ROOM_SNAPSHOT, // [S_ROOM_SNAPSHOT_VERSION, [[command, body], ...]], applied by the client at once
+    S_COMMAND_PROTOCOL_FEATURES // the features a server supports, legacy clients have no callback for it and ignore it
 };
 
 enum GameEventType
@@ -227,6 +246,14 @@ extern const char *S_PLAYER_SELF_REFERENCE_ID;
 
 extern const int S_ALL_ALIVE_PLAYERS;
 
+extern const int S_SUPPORTED_FEATURES;
+
+extern const int S_ROOM_SNAPSHOT_VERSION;
+
+// Notifications which only affect the show (animations, emotions, chat...).
+// They are dropped rather than queued for a client which doesn't keep up with reading.
+LIBQSGSCORE_EXPORT bool isCosmeticCommand(CommandType command);
+
 class LIBQSGSCORE_EXPORT Countdown
 {
 public:
@@ -271,9 +298,13 @@ public:
     {
         return m_messageBody;
     }
-    bool parse(const QByteArray &raw);
+    bool parse(const QByteArray &raw); // accepts both JSON and the binary form
     QByteArray toJson() const;
+    QByteArray toBinary() const;
+    // the binary form if S_FEATURE_BINARY_CODEC is negotiated, else JSON
+    QByteArray toByteArray(int features) const;
     QString toString() const;
+    static bool isBinary(const QByteArray &raw);
     PacketDescription packetDestination() const;
     PacketDescription packetSource() const;
     PacketDescription packetType() const;
@@ -282,13 +313,35 @@ public:
 
 protected:
     // @todo: use D-pointer to handle this
-    static unsigned int m_globalSerialSequence;
+    static QAtomicInteger<unsigned int> m_globalSerialSequence;
     CommandType m_command;
     PacketDescription m_packetDescription;
     QVariant m_messageBody;
 
     //helper functions
     static const int S_MAX_PACKET_SIZE;
+    static const char S_BINARY_PACKET_MARK;
+
+    bool parseBinary(const QByteArray &raw);
+};
+
+// Encodes a packet at most once for each wire format.
+// A broadcast hands the same implicitly shared QByteArray to every receiver instead of serializing the packet for each of them.
+// A packet without a globalSerial gets one, so that every packet a client receives can be identified for session resumption.
+class LIBQSGSCORE_EXPORT BroadcastPacket
+{
+public:
+    explicit BroadcastPacket(const Packet &packet);
+    const QByteArray &encoded(int features);
+    inline const Packet &packet() const
+    {
+        return m_packet;
+    }
+
+private:
+    Packet m_packet;
+    QByteArray m_json;
+    QByteArray m_binary;
 };
 }
 
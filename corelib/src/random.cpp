@@ -0,0 +1,113 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#include "random.h"
+
+#include <QAtomicInteger>
+#include <QDateTime>
+#include <QThreadStorage>
+
+namespace {
+
+inline quint64 rotl(quint64 x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+// used to expand the seed to the 256 bit state, as recommended by the authors of xoshiro
+inline quint64 splitMix64(quint64 &x)
+{
+    quint64 z = (x += Q_UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+QAtomicInteger<quint64> seedCounter;
+
+}
+
+QSgsRandom::QSgsRandom()
+{
+    seed(makeSeed());
+}
+
+QSgsRandom::QSgsRandom(quint64 seed)
+{
+    this->seed(seed);
+}
+
+void QSgsRandom::seed(quint64 seed)
+{
+    m_seed = seed;
+    quint64 x = seed;
+    for (int i = 0; i < 4; ++i)
+        m_state[i] = splitMix64(x);
+}
+
+quint64 QSgsRandom::next()
+{
+    const quint64 result = rotl(m_state[1] * 5, 7) * 9;
+    const quint64 t = m_state[1] << 17;
+
+    m_state[2] ^= m_state[0];
+    m_state[3] ^= m_state[1];
+    m_state[1] ^= m_state[2];
+    m_state[0] ^= m_state[3];
+
+    m_state[2] ^= t;
+    m_state[3] = rotl(m_state[3], 45);
+
+    return result;
+}
+
+quint32 QSgsRandom::bounded(quint32 bound)
+{
+    if (bound <= 1)
+        return 0;
+
+    // Lemire's multiply-and-reject, rejects only when the low part falls in the biased range
+    quint64 m = (next() >> 32) * bound;
+    quint32 low = static_cast<quint32>(m);
+    if (low < bound) {
+        const quint32 threshold = (0u - bound) % bound;
+        while (low < threshold) {
+            m = (next() >> 32) * bound;
+            low = static_cast<quint32>(m);
+        }
+    }
+
+    return static_cast<quint32>(m >> 32);
+}
+
+quint64 QSgsRandom::makeSeed()
+{
+    quint64 x = static_cast<quint64>(QDateTime::currentMSecsSinceEpoch()) ^ (seedCounter.fetchAndAddRelaxed(1) << 48);
+    return splitMix64(x);
+}
+
+QSgsRandom &QSgsRandom::local()
+{
+    static QThreadStorage<QSgsRandom *> generators;
+    if (!generators.hasLocalData())
+        generators.setLocalData(new QSgsRandom);
+
+    return *generators.localData();
+}
@@ -0,0 +1,75 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _RANDOM_H
+#define _RANDOM_H
+
+#include "libqsgscoreglobal.h"
+
+// A small and fast pseudo random number generator (xoshiro256**).
+// Every room owns one, so rooms do not share the state of qrand(), and a game can be
+// replayed exactly by seeding the generator of the room with the seed it recorded.
+class LIBQSGSCORE_EXPORT QSgsRandom
+{
+public:
+    // seeded with makeSeed()
+    QSgsRandom();
+    explicit QSgsRandom(quint64 seed);
+
+    void seed(quint64 seed);
+    inline quint64 initialSeed() const
+    {
+        return m_seed;
+    }
+
+    quint64 next();
+
+    // a uniformly distributed number in [0, bound), without the bias of next() % bound
+    quint32 bounded(quint32 bound);
+    inline int bounded(int bound)
+    {
+        return bound <= 0 ? 0 : static_cast<int>(bounded(static_cast<quint32>(bound)));
+    }
+
+    // Fisher-Yates
+    template<typename T>
+    void shuffle(QList<T> &list)
+    {
+        for (int i = list.length() - 1; i > 0; --i)
+            list.swap(i, bounded(i + 1));
+    }
+
+    template<typename T>
+    const T &pick(const QList<T> &list)
+    {
+        return list.at(bounded(list.length()));
+    }
+
+    // a seed which is different between calls, e.g. for rooms which are not replays
+    static quint64 makeSeed();
+    // for the code which has no room at hand, one generator per thread
+    static QSgsRandom &local();
+
+private:
+    quint64 m_seed;
+    quint64 m_state[4];
+};
+
+#endif
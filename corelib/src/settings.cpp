@@ -8,6 +8,12 @@ struct QSgsCoreSettingsPrivate
     QString serverName;
     uint16_t detectorPort;
     QString hostAddress;
+    int ioThreadCount;
+    bool tcpNoDelay;
+    bool tcpKeepAlive;
+    qint64 outboundLowWatermark;
+    qint64 outboundHighWatermark;
+    qint64 outboundLimit;
 
     QReadWriteLock *m;
 };
@@ -18,6 +24,12 @@ namespace {
     const QString hostAddressKey = QStringLiteral("HostAddress");
     const QString serverNameKey = QStringLiteral("ServerName");
     const QString detectorPortKey = QStringLiteral("DetectorPort");
+    const QString ioThreadCountKey = QStringLiteral("IOThreadCount");
+    const QString tcpNoDelayKey = QStringLiteral("TcpNoDelay");
+    const QString tcpKeepAliveKey = QStringLiteral("TcpKeepAlive");
+    const QString outboundLowWatermarkKey = QStringLiteral("OutboundLowWatermark");
+    const QString outboundHighWatermarkKey = QStringLiteral("OutboundHighWatermark");
+    const QString outboundLimitKey = QStringLiteral("OutboundLimit");
 }
 
 QSgsCoreSettings *QSgsCoreSettings::instance()
@@ -42,6 +54,12 @@ QSgsCoreSettings::QSgsCoreSettings()
     d->hostAddress = d->settings->value(hostAddressKey, QStringLiteral("server1.mogara.org:4466")).toString();
     d->serverName = d->settings->value(serverNameKey, QStringLiteral("QSanguosha\'s Server")).toString();
     d->detectorPort = d->settings->value(detectorPortKey, 9527u).toUInt();
+    d->ioThreadCount = d->settings->value(ioThreadCountKey, 0).toInt(); // 0 for QThread::idealThreadCount()
+    d->tcpNoDelay = d->settings->value(tcpNoDelayKey, true).toBool();
+    d->tcpKeepAlive = d->settings->value(tcpKeepAliveKey, true).toBool();
+    d->outboundLowWatermark = d->settings->value(outboundLowWatermarkKey, 256 * 1024).toLongLong();
+    d->outboundHighWatermark = d->settings->value(outboundHighWatermarkKey, 1024 * 1024).toLongLong();
+    d->outboundLimit = d->settings->value(outboundLimitKey, 8 * 1024 * 1024).toLongLong();
 
     d->m = new QReadWriteLock;
 }
@@ -121,3 +139,104 @@ void QSgsCoreSettings::setHostAddress(const QString &ha)
     s->d->settings->setValue(hostAddressKey, ha);
 }
 
+int QSgsCoreSettings::ioThreadCount()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->ioThreadCount;
+}
+
+void QSgsCoreSettings::setIoThreadCount(int count)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->ioThreadCount = count;
+    s->d->settings->setValue(ioThreadCountKey, count);
+}
+
+bool QSgsCoreSettings::tcpNoDelay()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->tcpNoDelay;
+}
+
+void QSgsCoreSettings::setTcpNoDelay(bool noDelay)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->tcpNoDelay = noDelay;
+    s->d->settings->setValue(tcpNoDelayKey, noDelay);
+}
+
+bool QSgsCoreSettings::tcpKeepAlive()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->tcpKeepAlive;
+}
+
+void QSgsCoreSettings::setTcpKeepAlive(bool keepAlive)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->tcpKeepAlive = keepAlive;
+    s->d->settings->setValue(tcpKeepAliveKey, keepAlive);
+}
+
+qint64 QSgsCoreSettings::outboundLowWatermark()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->outboundLowWatermark;
+}
+
+void QSgsCoreSettings::setOutboundLowWatermark(qint64 bytes)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->outboundLowWatermark = bytes;
+    s->d->settings->setValue(outboundLowWatermarkKey, bytes);
+}
+
+qint64 QSgsCoreSettings::outboundHighWatermark()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->outboundHighWatermark;
+}
+
+void QSgsCoreSettings::setOutboundHighWatermark(qint64 bytes)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->outboundHighWatermark = bytes;
+    s->d->settings->setValue(outboundHighWatermarkKey, bytes);
+}
+
+qint64 QSgsCoreSettings::outboundLimit()
+{
+    QSgsCoreSettings *s = instance();
+    QReadLocker l(s->d->m);
+    Q_UNUSED(l);
+    return s->d->outboundLimit;
+}
+
+void QSgsCoreSettings::setOutboundLimit(qint64 bytes)
+{
+    QSgsCoreSettings *s = instance();
+    QWriteLocker l(s->d->m);
+    Q_UNUSED(l);
+    s->d->outboundLimit = bytes;
+    s->d->settings->setValue(outboundLimitKey, bytes);
+}
@@ -20,6 +20,18 @@ public:
     static void setServerName(const QString &sn);
     static const QString &hostAddress();
     static void setHostAddress(const QString &ha);
+    static int ioThreadCount();
+    static void setIoThreadCount(int count);
+    static bool tcpNoDelay();
+    static void setTcpNoDelay(bool noDelay);
+    static bool tcpKeepAlive();
+    static void setTcpKeepAlive(bool keepAlive);
+    static qint64 outboundLowWatermark();
+    static void setOutboundLowWatermark(qint64 bytes);
+    static qint64 outboundHighWatermark();
+    static void setOutboundHighWatermark(qint64 bytes);
+    static qint64 outboundLimit();
+    static void setOutboundLimit(qint64 bytes);
 
 private:
     static QSgsCoreSettings *instance();
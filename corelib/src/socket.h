@@ -49,19 +49,51 @@ class LIBQSGSCORE_EXPORT ClientSocket : public QObject
     Q_OBJECT
 
 public:
+    enum Framing
+    {
+        LineFraming, // newline-delimited messages, the only format legacy peers understand
+        LengthPrefixedFraming // a 4-byte big-endian length header followed by the message
+    };
+
+    struct OutboundStatistics
+    {
+        qint64 pendingBytes; // queued, but not written to the network yet
+        qint64 peakPendingBytes;
+        quint64 sentMessages;
+        quint64 droppedMessages;
+        quint64 congestions; // how many times the high watermark was exceeded
+    };
+
     virtual void connectToHost() = 0;
     virtual void connectToHost(const QHostAddress &address) = 0;
     virtual void connectToHost(const QHostAddress &address, ushort port) = 0;
     virtual void disconnectFromHost() = 0;
     virtual void send(const QByteArray &message) = 0;
+    // the message is dropped instead of queued if the peer is congested, i.e. it doesn't keep up with reading
+    virtual void sendDroppable(const QByteArray &message) = 0;
     virtual bool isConnected() const = 0;
     virtual QString peerName() const = 0;
     virtual QString peerAddress() const = 0;
     virtual ushort peerPort() const = 0;
 
+    // Framing only applies to outgoing messages. Incoming messages are recognized by their first byte,
+    // so a peer can switch its framing right after the negotiation without any synchronization.
+    virtual void setFraming(Framing framing) = 0;
+    virtual Framing framing() const = 0;
+
+    // the QSanProtocol::ProtocolFeature flags negotiated with the peer, used for encoding outgoing packets
+    virtual void setProtocolFeatures(int features) = 0;
+    virtual int protocolFeatures() const = 0;
+
+    // The outbound queue of a connection is bounded. Over the high watermark the connection is congested until
+    // the queue drains below the low watermark, and over the limit the connection is aborted.
+    // congestion_changed() is emitted on both transitions.
+    virtual OutboundStatistics outboundStatistics() const = 0;
+
 signals:
     void message_got(const QByteArray &msg);
     void error_message(const QString &msg);
+    void congestion_changed(bool congested);
     void disconnected();
     void connected();
 };
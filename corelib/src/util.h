@@ -22,20 +22,24 @@
 #define _UTIL_H
 
 #include "libqsgscoreglobal.h"
+#include "random.h"
 
 #if 0
 // for header generation
 class _EXPORT QSgsCoreUtil
 #endif
 
+// prefer the overload with the generator of the room in game logic, so that the game can be replayed
 template<typename T>
 void qShuffle(QList<T> &list)
 {
-    int i, n = list.length();
-    for (i = 0; i < n; i++) {
-        int r = qrand() % (n - i) + i;
-        list.swap(i, r);
-    }
+    QSgsRandom::local().shuffle(list);
+}
+
+template<typename T>
+void qShuffle(QList<T> &list, QSgsRandom &random)
+{
+    random.shuffle(list);
 }
 
 // lua interpreter related
@@ -37,6 +37,11 @@ HEADERS += \
     src/skill.h \
     src/structs.h \
     src/exppattern.h \
+    src/atom.h \
+    src/cardcatalog.h \
+    src/simulation.h \
+    src/batchsimulation.h \
+    src/constlistview.h \
     src/enumeration.h \
     src/translator.h \
     cardfaces/base.h
@@ -55,6 +60,10 @@ SOURCES += \
     src/skill.cpp \
     src/structs.cpp \
     src/exppattern.cpp \
+    src/atom.cpp \
+    src/cardcatalog.cpp \
+    src/simulation.cpp \
+    src/batchsimulation.cpp \
     src/translator.cpp \
     cardfaces/base.cpp
 
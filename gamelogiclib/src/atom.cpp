@@ -0,0 +1,141 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#include "atom.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+namespace {
+class AtomTable
+{
+public:
+    AtomTable()
+    {
+        // id 0 is the empty name
+        names << QString();
+        ids.insert(QString(), 0);
+    }
+
+    QHash<QString, int> ids;
+    QVector<QString> names;
+    QReadWriteLock lock;
+
+    // copies of the tables above made by Atom::freeze(), never changed afterwards, so they are read without the lock
+    QHash<QString, int> frozenIds;
+    QVector<QString> frozenNames;
+    QAtomicInt frozen;
+};
+
+AtomTable &atomTable()
+{
+    static AtomTable table;
+    return table;
+}
+}
+
+Atom::Atom(const QString &name)
+{
+    AtomTable &table = atomTable();
+    if (table.frozen.loadAcquire()) {
+        QHash<QString, int>::const_iterator it = table.frozenIds.constFind(name);
+        if (it != table.frozenIds.constEnd()) {
+            m_id = it.value();
+            return;
+        }
+    }
+
+    {
+        QReadLocker l(&table.lock);
+        QHash<QString, int>::const_iterator it = table.ids.constFind(name);
+        if (it != table.ids.constEnd()) {
+            m_id = it.value();
+            return;
+        }
+    }
+
+    QWriteLocker l(&table.lock);
+    QHash<QString, int>::const_iterator it = table.ids.constFind(name);
+    if (it != table.ids.constEnd()) {
+        m_id = it.value();
+        return;
+    }
+
+    m_id = table.names.size();
+    table.names << name;
+    table.ids.insert(name, m_id);
+}
+
+Atom Atom::lookup(const QString &name)
+{
+    AtomTable &table = atomTable();
+    Atom atom;
+    if (table.frozen.loadAcquire()) {
+        QHash<QString, int>::const_iterator it = table.frozenIds.constFind(name);
+        if (it != table.frozenIds.constEnd()) {
+            atom.m_id = it.value();
+            return atom;
+        }
+    }
+
+    QReadLocker l(&table.lock);
+    atom.m_id = table.ids.value(name, 0);
+    return atom;
+}
+
+Atom Atom::fixed(const QString &name)
+{
+    AtomTable &table = atomTable();
+    if (!table.frozen.loadAcquire())
+        return Atom(name);
+
+    Atom atom;
+    atom.m_id = table.frozenIds.value(name, 0);
+    return atom;
+}
+
+bool Atom::isFixed() const
+{
+    AtomTable &table = atomTable();
+    return !table.frozen.loadAcquire() || m_id < table.frozenNames.size();
+}
+
+QString Atom::name() const
+{
+    AtomTable &table = atomTable();
+    if (table.frozen.loadAcquire() && m_id < table.frozenNames.size())
+        return table.frozenNames.at(m_id);
+
+    QReadLocker l(&table.lock);
+    return table.names.at(m_id);
+}
+
+void Atom::freeze()
+{
+    AtomTable &table = atomTable();
+    QWriteLocker l(&table.lock);
+    if (table.frozen.load())
+        return;
+
+    table.frozenIds = table.ids;
+    table.frozenNames = table.names;
+    table.frozen.storeRelease(1);
+}
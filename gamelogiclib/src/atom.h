@@ -0,0 +1,93 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _ATOM_H
+#define _ATOM_H
+
+#include "libqsgsgamelogicglobal.h"
+
+// An interned name (skill, card, mark, flag, pile...).
+// Every distinct name is mapped to a small integer once, and the integer is what
+// gets hashed and compared afterwards. The atom with id 0 is the empty name.
+class LIBQSGSGAMELOGIC_EXPORT Atom
+{
+public:
+    inline Atom()
+        : m_id(0)
+    {
+    }
+
+    explicit Atom(const QString &name);
+
+    // does not intern the name, returns the empty atom if it was never interned
+    static Atom lookup(const QString &name);
+
+    // For names which may be made up while playing, e.g. marks and flags with the name of a player in them.
+    // Before freeze() the name is interned as by the constructor. Afterwards only the names interned so far
+    // are found, without any lock, and the empty atom is returned for any other name instead of interning it,
+    // so such names can't grow the table forever. Their owners keep them by their names instead.
+    static Atom fixed(const QString &name);
+
+    inline int id() const
+    {
+        return m_id;
+    }
+
+    inline bool isNull() const
+    {
+        return m_id == 0;
+    }
+
+    QString name() const;
+
+    // interned before freeze(), i.e. found by fixed(). Every atom is fixed until freeze() is called
+    bool isFixed() const;
+
+    // The names interned so far are looked up without any lock afterwards, names interned later still take the lock.
+    // Called by GameLogicCore::freeze() once the packages are loaded
+    static void freeze();
+
+    inline bool operator==(const Atom &other) const
+    {
+        return m_id == other.m_id;
+    }
+
+    inline bool operator!=(const Atom &other) const
+    {
+        return m_id != other.m_id;
+    }
+
+    inline bool operator<(const Atom &other) const
+    {
+        return m_id < other.m_id;
+    }
+
+private:
+    int m_id;
+};
+
+Q_DECLARE_TYPEINFO(Atom, Q_PRIMITIVE_TYPE);
+
+inline uint qHash(const Atom &atom, uint seed = 0)
+{
+    return qHash(atom.id(), seed);
+}
+
+#endif
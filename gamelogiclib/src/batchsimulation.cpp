@@ -0,0 +1,269 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#include "batchsimulation.h"
+#include "simulation.h"
+#include "logiccore.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+
+// the games [begin, end) which a worker still has to run
+struct GameRange
+{
+    QMutex mutex;
+    int begin;
+    int end;
+};
+
+class BatchWorker : public QThread
+{
+public:
+    BatchWorker(const GameSimulator *simulator, quint64 firstSeed, QVector<GameRange *> *ranges, int index)
+        : m_simulator(simulator), m_firstSeed(firstSeed), m_ranges(ranges), m_index(index)
+    {
+    }
+
+    BatchReport report;
+
+protected:
+    void run() override
+    {
+        int game = -1;
+        while ((game = takeGame()) != -1) {
+            SimulationResult result = m_simulator->run(m_firstSeed + static_cast<quint64>(game));
+            record(result);
+        }
+    }
+
+private:
+    int takeGame()
+    {
+        GameRange *own = m_ranges->at(m_index);
+        {
+            QMutexLocker locker(&own->mutex);
+            if (own->begin < own->end)
+                return own->begin++;
+        }
+
+        // steal the back half of the range of an other worker, starting from the next one so that thieves spread out
+        for (int i = 1; i < m_ranges->length(); ++i) {
+            GameRange *victim = m_ranges->at((m_index + i) % m_ranges->length());
+            int begin = 0;
+            int end = 0;
+            {
+                QMutexLocker locker(&victim->mutex);
+                int left = victim->end - victim->begin;
+                if (left <= 0)
+                    continue;
+
+                begin = victim->end - (left + 1) / 2;
+                end = victim->end;
+                victim->end = begin;
+            }
+
+            QMutexLocker locker(&own->mutex);
+            own->begin = begin + 1;
+            own->end = end;
+            return begin;
+        }
+
+        // games never create games, so nothing is left once every range is empty
+        return -1;
+    }
+
+    void record(const SimulationResult &result)
+    {
+        ++report.games;
+        report.rounds += result.rounds;
+        report.cardUses += result.cardUses;
+        report.gameNsecs += result.elapsedNsecs;
+        report.minGameNsecs = report.games == 1 ? result.elapsedNsecs : qMin(report.minGameNsecs, result.elapsedNsecs);
+        report.maxGameNsecs = qMax(report.maxGameNsecs, result.elapsedNsecs);
+
+        if (result.finished)
+            ++report.finishedGames;
+
+        for (int i = 0; i < result.generals.length(); ++i) {
+            bool won = result.finished && result.winnerSeats.contains(i + 1);
+            bool survived = result.survivorSeats.contains(i + 1);
+            foreach (const QString &general, result.generals.at(i)) {
+                BatchReport::GeneralStats &stats = report.generals[general];
+                ++stats.games;
+                if (won)
+                    ++stats.wins;
+                if (survived)
+                    ++stats.survivals;
+            }
+        }
+    }
+
+    const GameSimulator *m_simulator;
+    quint64 m_firstSeed;
+    QVector<GameRange *> *m_ranges;
+    int m_index;
+};
+
+}
+
+BatchReport::BatchReport()
+    : games(0), finishedGames(0), rounds(0), cardUses(0), elapsedNsecs(0), gameNsecs(0), minGameNsecs(0), maxGameNsecs(0)
+{
+}
+
+void BatchReport::merge(const BatchReport &other)
+{
+    if (other.games == 0)
+        return;
+
+    minGameNsecs = games == 0 ? other.minGameNsecs : qMin(minGameNsecs, other.minGameNsecs);
+    maxGameNsecs = qMax(maxGameNsecs, other.maxGameNsecs);
+    games += other.games;
+    finishedGames += other.finishedGames;
+    rounds += other.rounds;
+    cardUses += other.cardUses;
+    gameNsecs += other.gameNsecs;
+
+    for (auto i = other.generals.cbegin(), e = other.generals.cend(); i != e; ++i) {
+        GeneralStats &stats = generals[i.key()];
+        stats.games += i.value().games;
+        stats.wins += i.value().wins;
+        stats.survivals += i.value().survivals;
+    }
+}
+
+double BatchReport::gamesPerSecond() const
+{
+    if (elapsedNsecs <= 0)
+        return 0;
+
+    return games * 1e9 / elapsedNsecs;
+}
+
+QString BatchReport::toString() const
+{
+    QString r;
+    QTextStream out(&r);
+
+    out << QStringLiteral("%1 games in %2 ms, %3 games per second").arg(games).arg(elapsedNsecs / 1000000).arg(gamesPerSecond(), 0, 'f', 1) << endl;
+    if (games > 0) {
+        out << QStringLiteral("game time: average %1 us, min %2 us, max %3 us").arg(gameNsecs / games / 1000).arg(minGameNsecs / 1000).arg(maxGameNsecs / 1000) << endl;
+        out << QStringLiteral("finished: %1, average rounds: %2, average card uses: %3").arg(finishedGames).arg(double(rounds) / games, 0, 'f', 2).arg(double(cardUses) / games, 0, 'f', 2) << endl;
+    }
+
+    QStringList names = generals.keys();
+    std::sort(names.begin(), names.end(), [this](const QString &a, const QString &b) {
+        GeneralStats x = generals.value(a);
+        GeneralStats y = generals.value(b);
+        // x.wins / x.games > y.wins / y.games, without the division
+        qint64 left = qint64(x.wins) * y.games;
+        qint64 right = qint64(y.wins) * x.games;
+        if (left != right)
+            return left > right;
+        left = qint64(x.survivals) * y.games;
+        right = qint64(y.survivals) * x.games;
+        return left != right ? left > right : a < b;
+    });
+
+    foreach (const QString &name, names) {
+        GeneralStats stats = generals.value(name);
+        out << QStringLiteral("%1: won %2 / %3, %4%, survived %5%").arg(name).arg(stats.wins).arg(stats.games)
+                   .arg(stats.wins * 100.0 / stats.games, 0, 'f', 2).arg(stats.survivals * 100.0 / stats.games, 0, 'f', 2) << endl;
+    }
+
+    return r;
+}
+
+class BatchSimulatorPrivate
+{
+public:
+    const GameSimulator *simulator;
+    int threadCount;
+};
+
+BatchSimulator::BatchSimulator(const GameSimulator *simulator)
+    : d_ptr(new BatchSimulatorPrivate)
+{
+    Q_D(BatchSimulator);
+    d->simulator = simulator;
+    d->threadCount = qMax(QThread::idealThreadCount(), 1);
+}
+
+BatchSimulator::~BatchSimulator()
+{
+    Q_D(BatchSimulator);
+    delete d;
+}
+
+int BatchSimulator::threadCount() const
+{
+    Q_D(const BatchSimulator);
+    return d->threadCount;
+}
+
+void BatchSimulator::setThreadCount(int count)
+{
+    Q_D(BatchSimulator);
+    d->threadCount = qMax(count, 1);
+}
+
+BatchReport BatchSimulator::run(quint64 firstSeed, int games) const
+{
+    Q_D(const BatchSimulator);
+    // Freeze the tables of the core here, before the workers start. The first RoomObject would do it otherwise,
+    // on whichever worker creates it first while the other ones are already looking names up.
+    GameLogicCore::instance()->freeze();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int n = qBound(1, d->threadCount, qMax(games, 1));
+    QVector<GameRange *> ranges;
+    for (int i = 0; i < n; ++i) {
+        GameRange *range = new GameRange;
+        range->begin = qint64(games) * i / n;
+        range->end = qint64(games) * (i + 1) / n;
+        ranges << range;
+    }
+
+    QList<BatchWorker *> workers;
+    for (int i = 0; i < n; ++i)
+        workers << new BatchWorker(d->simulator, firstSeed, &ranges, i);
+
+    foreach (BatchWorker *worker, workers)
+        worker->start();
+
+    BatchReport report;
+    foreach (BatchWorker *worker, workers) {
+        worker->wait();
+        report.merge(worker->report);
+    }
+
+    qDeleteAll(workers);
+    qDeleteAll(ranges);
+
+    report.elapsedNsecs = timer.nsecsElapsed();
+    return report;
+}
@@ -0,0 +1,84 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _BATCHSIMULATION_H
+#define _BATCHSIMULATION_H
+
+#include "libqsgsgamelogicglobal.h"
+
+class GameSimulator;
+
+struct LIBQSGSGAMELOGIC_EXPORT BatchReport
+{
+    BatchReport();
+
+    // of all the games, a game stopped by the round limit has no winner but its survivors are counted
+    struct GeneralStats
+    {
+        int games;
+        int wins;
+        int survivals;
+    };
+
+    int games;
+    int finishedGames;
+    qint64 rounds;
+    qint64 cardUses;
+    // the wall time of the whole batch, and the sum, minimum and maximum of the time of each game
+    qint64 elapsedNsecs;
+    qint64 gameNsecs;
+    qint64 minGameNsecs;
+    qint64 maxGameNsecs;
+    QHash<QString, GeneralStats> generals;
+
+    void merge(const BatchReport &other);
+    double gamesPerSecond() const;
+    // a human readable report, generals sorted by win rate, then by survival rate
+    QString toString() const;
+};
+
+class BatchSimulatorPrivate;
+
+// Runs a batch of games on all cores. Game i of the batch uses the seed firstSeed + i, so the report
+// does not depend on the number of threads.
+// Each worker thread owns a range of games and takes them from the front. When its range is empty,
+// it steals the back half of the range of another worker, so the threads stay busy until the end
+// even if the lengths of the games differ a lot. The workers share nothing mutable except the ranges,
+// each of them has its own report which is merged when all of them finish.
+class LIBQSGSGAMELOGIC_EXPORT BatchSimulator final
+{
+public:
+    // the simulator is shared by all workers and must not be changed during run()
+    explicit BatchSimulator(const GameSimulator *simulator);
+    ~BatchSimulator();
+
+    // QThread::idealThreadCount() by default
+    int threadCount() const;
+    void setThreadCount(int count);
+
+    BatchReport run(quint64 firstSeed, int games) const;
+
+private:
+    Q_DISABLE_COPY(BatchSimulator)
+    Q_DECLARE_PRIVATE(BatchSimulator)
+    BatchSimulatorPrivate *d_ptr;
+};
+
+#endif
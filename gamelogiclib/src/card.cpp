@@ -38,7 +38,7 @@ public:
     int id;
     QString skillName;
     QString showSkill;
-    QStringList flags;
+    QVector<Atom> flags;
 };
 
 const int Card::S_UNKNOWN_CARD_ID = -1;
@@ -71,6 +71,21 @@ Card::~Card()
     delete d;
 }
 
+void Card::reset(const CardFace *cardFace, QSgsEnum::CardSuit suit, int number)
+{
+    Q_D(Card);
+    d->cardFace = cardFace;
+    d->suit = suit;
+    d->number = number;
+    d->canRecast = false;
+    d->transferable = false;
+    d->mute = false;
+    d->subcards.clear();
+    d->skillName.clear();
+    d->showSkill.clear();
+    d->flags.clear();
+}
+
 QString Card::suitString() const
 {
     return Suit2String(suit());
@@ -616,10 +631,14 @@ void Card::setShowSkill(const QString &skillName)
     d->showSkill = skillName;
 }
 
-const QStringList &Card::flags() const
+QStringList Card::flags() const
 {
     Q_D(const Card);
-    return d->flags;
+    QStringList l;
+    foreach (const Atom &flag, d->flags)
+        l << flag.name();
+
+    return l;
 }
 
 const CardFace *Card::cardFace() const
@@ -650,13 +669,10 @@ void Card::addSubcard(Card *card)
         addSubcards(card->subcards());
 }
 
-QList<const Card *> Card::subcards() const
+ConstListView<Card> Card::subcards() const
 {
     Q_D(const Card);
-    QList<const Card *> c;
-    foreach (Card *card, d->subcards)
-        c << card;
-    return c;
+    return ConstListView<Card>(d->subcards);
 }
 
 const QList<Card *> &Card::subcards()
@@ -701,9 +717,14 @@ void Card::setFlag(const QString &flag)
     else if (flag.startsWith(QChar::fromLatin1(symbol_c))) {
         QString copy = flag;
         copy.remove(0, 1); // only remove the first "-", but not all "-"s
-        d->flags.removeOne(copy);
-    } else if (!d->flags.contains(flag))
-        d->flags << flag;
+        Atom atom = Atom::lookup(copy);
+        if (!atom.isNull())
+            d->flags.removeOne(atom);
+    } else {
+        Atom atom(flag);
+        if (!d->flags.contains(atom))
+            d->flags << atom;
+    }
 }
 
 void Card::setFlags(const QStringList &fs)
@@ -716,9 +737,14 @@ void Card::setFlags(const QStringList &fs)
 }
 
 bool Card::hasFlag(const QString &flag) const
+{
+    return hasFlag(Atom::lookup(flag));
+}
+
+bool Card::hasFlag(Atom flag) const
 {
     Q_D(const Card);
-    return d->flags.contains(flag);
+    return !flag.isNull() && d->flags.contains(flag);
 }
 
 void Card::clearFlags()
@@ -23,6 +23,8 @@
 
 #include "libqsgsgamelogicglobal.h"
 #include "enumeration.h"
+#include "atom.h"
+#include "constlistview.h"
 
 class CardPrivate;
 class CardFace;
@@ -41,6 +43,8 @@ public:
     Card(RoomObject *roomObject, const CardFace *cardFace, int id, QSgsEnum::CardSuit suit = QSgsEnum::CardSuit::Tbd, int number = -1, bool canRecast = false, bool transferable = false);
     // This dtor is not virtual!!!!
     ~Card();
+    // resets this card as if it is newly created, RoomObject uses this to reuse released virtual cards
+    void reset(const CardFace *cardFace, QSgsEnum::CardSuit suit = QSgsEnum::CardSuit::Tbd, int number = -1);
 
     int id() const;
     void setId(int id);
@@ -80,6 +84,7 @@ public:
     void setFlag(const QString &flag);
     void setFlags(const QStringList &fs);
     bool hasFlag(const QString &flag) const;
+    bool hasFlag(Atom flag) const;
     void clearFlags();
 
     bool isVirtualCard() const;
@@ -88,7 +93,7 @@ public:
 
     void addSubcard(int cardId);
     void addSubcard(Card *card);
-    QList<const Card *> subcards() const;
+    ConstListView<Card> subcards() const;
     const QList<Card *> &subcards();
     void clearSubcards();
     QString subcardString() const;
@@ -99,7 +104,7 @@ public:
     const QString &showSkill() const;
     void setShowSkill(const QString &skillName);
 
-    const QStringList &flags() const;
+    QStringList flags() const;
 
     const CardFace *cardFace() const;
     const QString &cardFaceName() const;
@@ -0,0 +1,53 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#include "cardcatalog.h"
+#include "card.h"
+
+CardCatalog::CardCatalog()
+{
+}
+
+int CardCatalog::append(const Card *card)
+{
+    m_faces << card->cardFace();
+    m_suits << static_cast<qint16>(card->suit());
+    m_numbers << static_cast<qint8>(card->number());
+
+    quint8 bits = 0;
+    if (card->canRecast())
+        bits |= CanRecast;
+    if (card->isTransferable())
+        bits |= Transferable;
+    m_bits << bits;
+
+    return m_faces.length();
+}
+
+QList<int> CardCatalog::idsOf(const CardFace *face) const
+{
+    QList<int> ids;
+    for (int i = 0; i < m_faces.length(); ++i) {
+        if (m_faces.at(i) == face)
+            ids << (i + 1);
+    }
+
+    return ids;
+}
@@ -0,0 +1,92 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _CARDCATALOG_H
+#define _CARDCATALOG_H
+
+#include "libqsgsgamelogicglobal.h"
+#include "enumeration.h"
+
+class Card;
+class CardFace;
+
+// The immutable properties of every physical card of all the packages, shared by all rooms.
+// The properties are stored as parallel arrays indexed by (catalog id - 1), so scanning the suits,
+// numbers or faces of the cards only touches the array which is scanned.
+// GameLogicCore fills the catalog when packages are added, it is never changed after the first game starts.
+class LIBQSGSGAMELOGIC_EXPORT CardCatalog
+{
+public:
+    CardCatalog();
+
+    // returns the catalog id of the card
+    int append(const Card *card);
+
+    inline int count() const
+    {
+        return m_faces.length();
+    }
+
+    inline bool isValid(int catalogId) const
+    {
+        return catalogId > 0 && catalogId <= m_faces.length();
+    }
+
+    inline const CardFace *face(int catalogId) const
+    {
+        return m_faces.at(catalogId - 1);
+    }
+
+    inline QSgsEnum::CardSuit suit(int catalogId) const
+    {
+        return static_cast<QSgsEnum::CardSuit>(m_suits.at(catalogId - 1));
+    }
+
+    inline int number(int catalogId) const
+    {
+        return m_numbers.at(catalogId - 1);
+    }
+
+    inline bool canRecast(int catalogId) const
+    {
+        return (m_bits.at(catalogId - 1) & CanRecast) != 0;
+    }
+
+    inline bool isTransferable(int catalogId) const
+    {
+        return (m_bits.at(catalogId - 1) & Transferable) != 0;
+    }
+
+    QList<int> idsOf(const CardFace *face) const;
+
+private:
+    enum Bit
+    {
+        CanRecast = 0x1,
+        Transferable = 0x2
+    };
+
+    QVector<const CardFace *> m_faces;
+    QVector<qint16> m_suits;
+    QVector<qint8> m_numbers;
+    QVector<quint8> m_bits;
+};
+
+#endif
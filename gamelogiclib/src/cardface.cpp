@@ -1,6 +1,19 @@
 
 #include "cardface.h"
 
+#include <QAtomicPointer>
+#include <QBitArray>
+#include <QHash>
+#include <QReadWriteLock>
+
+namespace {
+QHash<QByteArray, int> kindIds;
+QReadWriteLock kindIdsLock;
+// a copy of kindIds made by freezeKinds(), never changed afterwards, so it is read without the lock
+QHash<QByteArray, int> frozenKindIds;
+QAtomicInt kindIdsFrozen;
+}
+
 class CardFacePrivate
 {
 public:
@@ -8,6 +21,9 @@ public:
     bool willThrow;
     bool hasPreact;
 
+    // built on the first kind check, since metaObject() is not final in the constructor
+    QAtomicPointer<QBitArray> kinds;
+    QList<int> extraKinds;
 };
 
 CardFace::CardFace(const QString &name, QSgsEnum::CardHandlingMethod handlingMethod, bool willThrow, bool hasPreact)
@@ -24,6 +40,7 @@ CardFace::CardFace(const QString &name, QSgsEnum::CardHandlingMethod handlingMet
 CardFace::~CardFace()
 {
     Q_D(CardFace);
+    delete d->kinds.load();
     delete d;
 }
 
@@ -127,6 +144,76 @@ void CardFace::onNullified(Player *target) const
 
 bool CardFace::isKindOf(const char *cardType) const
 {
-    return inherits(cardType);
+    return isKindOfId(kindId(cardType));
+}
+
+int CardFace::kindId(const char *cardType)
+{
+    QByteArray name = QByteArray::fromRawData(cardType, qstrlen(cardType));
+    if (kindIdsFrozen.loadAcquire()) {
+        QHash<QByteArray, int>::const_iterator it = frozenKindIds.constFind(name);
+        if (it != frozenKindIds.constEnd())
+            return it.value();
+    }
+
+    {
+        QReadLocker l(&kindIdsLock);
+        QHash<QByteArray, int>::const_iterator it = kindIds.constFind(name);
+        if (it != kindIds.constEnd())
+            return it.value();
+    }
+
+    QWriteLocker l(&kindIdsLock);
+    QHash<QByteArray, int>::const_iterator it = kindIds.constFind(name);
+    if (it != kindIds.constEnd())
+        return it.value();
+
+    int id = kindIds.size();
+    kindIds.insert(QByteArray(cardType), id);
+    return id;
+}
+
+void CardFace::freezeKinds()
+{
+    QWriteLocker l(&kindIdsLock);
+    if (kindIdsFrozen.load())
+        return;
+
+    frozenKindIds = kindIds;
+    kindIdsFrozen.storeRelease(1);
+}
+
+bool CardFace::isKindOfId(int kindId) const
+{
+    Q_D(const CardFace);
+    const QBitArray *kinds = d->kinds.loadAcquire();
+    if (kinds == nullptr) {
+        QBitArray *built = new QBitArray;
+        QList<int> ids = d->extraKinds;
+        for (const QMetaObject *meta = metaObject(); meta != nullptr; meta = meta->superClass())
+            ids << CardFace::kindId(meta->className());
+
+        foreach (int id, ids) {
+            if (id >= built->size())
+                built->resize(id + 1);
+            built->setBit(id);
+        }
+
+        if (d->kinds.testAndSetOrdered(nullptr, built)) {
+            kinds = built;
+        } else {
+            delete built;
+            kinds = d->kinds.loadAcquire();
+        }
+    }
+
+    return kindId >= 0 && kindId < kinds->size() && kinds->testBit(kindId);
+}
+
+void CardFace::addKind(const char *cardType)
+{
+    Q_D(CardFace);
+    Q_ASSERT(d->kinds.load() == nullptr);
+    d->extraKinds << kindId(cardType);
 }
 
@@ -50,12 +50,23 @@ public:
     virtual QStringList checkTargetModSkillShow(const CardUseStruct & /* use */) const;
 
     virtual void onNullified(Player *target) const;
-    virtual bool isKindOf(const char *cardType) const; // for YanXiao and LuaCard? Should we make Yanxiao as "move cards out of game"?
+    // Not virtual: a face is of its C++ classes, plus the kinds it declares with addKind() (e.g. LuaCard)
+    bool isKindOf(const char *cardType) const;
+
+    // Every class name gets an integer kind id the first time it is seen.
+    // isKindOf() looks the name up on every call, so resolve the id once and use isKindOfId() on hot paths.
+    static int kindId(const char *cardType);
+    bool isKindOfId(int kindId) const;
+    // the kinds known so far are looked up without any lock afterwards, see GameLogicCore::freeze()
+    static void freezeKinds();
 
 
 protected:
     explicit CardFace(const QString &name, QSgsEnum::CardHandlingMethod handlingMethod = QSgsEnum::CardHandlingMethod::Use, bool willThrow = false, bool hasPreact = false);
 
+    // for faces which are not a C++ class of their kind, e.g. those defined in Lua
+    void addKind(const char *cardType);
+
     Q_DECLARE_PRIVATE(CardFace)
     CardFacePrivate *d_ptr;
 };
@@ -0,0 +1,209 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _CONSTLISTVIEW_H
+#define _CONSTLISTVIEW_H
+
+#include "libqsgsgamelogicglobal.h"
+
+#include <iterator>
+
+// A read-only view of a QList<T *> which yields const T * without copying the list.
+// An element can be skipped, e.g. the player itself in Player::siblings().
+// The view refers to the list of its owner, so it must not outlive the owner, and it is
+// invalidated when the list changes. Use toList() to iterate over a snapshot while moving cards.
+template <typename T>
+class ConstListView
+{
+public:
+    typedef typename QList<T *>::const_iterator ListIterator;
+
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef const T *value_type;
+        typedef qptrdiff difference_type;
+        typedef const T *const *pointer;
+        typedef const T *reference;
+
+        inline const_iterator(ListIterator it, ListIterator end, const T *except)
+            : m_it(it), m_end(end), m_except(except)
+        {
+            skip();
+        }
+
+        inline const T *operator*() const
+        {
+            return *m_it;
+        }
+
+        inline const_iterator &operator++()
+        {
+            ++m_it;
+            skip();
+            return *this;
+        }
+
+        inline const_iterator operator++(int)
+        {
+            const_iterator r = *this;
+            ++*this;
+            return r;
+        }
+
+        inline bool operator==(const const_iterator &other) const
+        {
+            return m_it == other.m_it;
+        }
+
+        inline bool operator!=(const const_iterator &other) const
+        {
+            return m_it != other.m_it;
+        }
+
+    private:
+        inline void skip()
+        {
+            if (m_except != nullptr) {
+                while (m_it != m_end && *m_it == m_except)
+                    ++m_it;
+            }
+        }
+
+        ListIterator m_it;
+        ListIterator m_end;
+        const T *m_except;
+    };
+    typedef const_iterator iterator;
+
+    // an empty view
+    inline ConstListView()
+        : m_list(&emptyList()), m_except(nullptr)
+    {
+    }
+
+    inline ConstListView(const QList<T *> &list, const T *except = nullptr)
+        : m_list(&list), m_except(except != nullptr && list.contains(const_cast<T *>(except)) ? except : nullptr)
+    {
+    }
+
+    inline const_iterator begin() const
+    {
+        return const_iterator(m_list->constBegin(), m_list->constEnd(), m_except);
+    }
+
+    inline const_iterator end() const
+    {
+        return const_iterator(m_list->constEnd(), m_list->constEnd(), m_except);
+    }
+
+    inline const_iterator constBegin() const
+    {
+        return begin();
+    }
+
+    inline const_iterator constEnd() const
+    {
+        return end();
+    }
+
+    inline int length() const
+    {
+        return m_except == nullptr ? m_list->length() : m_list->length() - 1;
+    }
+
+    inline int size() const
+    {
+        return length();
+    }
+
+    inline int count() const
+    {
+        return length();
+    }
+
+    inline bool isEmpty() const
+    {
+        return length() == 0;
+    }
+
+    inline bool contains(const T *t) const
+    {
+        return t != m_except && m_list->contains(const_cast<T *>(t));
+    }
+
+    const T *at(int i) const
+    {
+        if (m_except == nullptr)
+            return m_list->at(i);
+
+        for (const_iterator it = begin(); it != end(); ++it) {
+            if (i-- == 0)
+                return *it;
+        }
+
+        Q_ASSERT(false);
+        return nullptr;
+    }
+
+    inline const T *value(int i) const
+    {
+        return (i >= 0 && i < length()) ? at(i) : nullptr;
+    }
+
+    inline const T *first() const
+    {
+        return *begin();
+    }
+
+    const T *last() const
+    {
+        return at(length() - 1);
+    }
+
+    QList<const T *> toList() const
+    {
+        QList<const T *> l;
+        l.reserve(length());
+        for (const_iterator it = begin(); it != end(); ++it)
+            l << *it;
+
+        return l;
+    }
+
+    // for the callers which keep the result, this copies the elements
+    inline operator QList<const T *>() const
+    {
+        return toList();
+    }
+
+private:
+    static const QList<T *> &emptyList()
+    {
+        static const QList<T *> l;
+        return l;
+    }
+
+    const QList<T *> *m_list;
+    const T *m_except;
+};
+
+#endif
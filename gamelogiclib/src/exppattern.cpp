@@ -22,176 +22,445 @@
 #include "player.h"
 #include "card.h"
 #include "cardface.h"
+#include "roomobject.h"
 
-ExpPattern::ExpPattern(const QString &exp)
+#include <QHash>
+#include <QReadWriteLock>
+#include <QThreadStorage>
+#include <QVector>
+
+namespace {
+enum SuitBit
 {
-    this->exp = exp;
+    SpadeBit = 0x1,
+    ClubBit = 0x2,
+    HeartBit = 0x4,
+    DiamondBit = 0x8,
+    NoSuitBlackBit = 0x10,
+    NoSuitRedBit = 0x20,
+    NoSuitBit = 0x40,
+
+    BlackBits = SpadeBit | ClubBit | NoSuitBlackBit,
+    RedBits = HeartBit | DiamondBit | NoSuitRedBit,
+    AllSuitBits = BlackBits | RedBits | NoSuitBit
+};
+
+// the same classification as Card::Suit2String
+int suitBit(QSgsEnum::CardSuit suit)
+{
+    switch (suit) {
+        case QSgsEnum::CardSuit::Spade: return SpadeBit;
+        case QSgsEnum::CardSuit::Heart: return HeartBit;
+        case QSgsEnum::CardSuit::Club: return ClubBit;
+        case QSgsEnum::CardSuit::Diamond: return DiamondBit;
+        case QSgsEnum::CardSuit::Black: return NoSuitBlackBit;
+        case QSgsEnum::CardSuit::Red: return NoSuitRedBit;
+        default: return NoSuitBit;
+    }
 }
 
-bool ExpPattern::match(const Player *player, const Card *card) const
+int suitBits(const QString &suit)
 {
-    QStringList splited = exp.split(QStringLiteral("$"));
-    foreach (const QString &oneExp, splited)
-        if (this->matchOne(player, card, oneExp)) return true;
+    if (suit == QStringLiteral("spade"))
+        return SpadeBit;
+    else if (suit == QStringLiteral("club"))
+        return ClubBit;
+    else if (suit == QStringLiteral("heart"))
+        return HeartBit;
+    else if (suit == QStringLiteral("diamond"))
+        return DiamondBit;
+    else if (suit == QStringLiteral("no_suit_black"))
+        return NoSuitBlackBit;
+    else if (suit == QStringLiteral("no_suit_red"))
+        return NoSuitRedBit;
+    else if (suit == QStringLiteral("no_suit"))
+        return NoSuitBit;
+    else if (suit == QStringLiteral("black"))
+        return BlackBits;
+    else if (suit == QStringLiteral("red"))
+        return RedBits;
 
-    return false;
+    return 0;
 }
 
-const QString &ExpPattern::getPatternString() const
+// numbers in [0, 64) are kept in a bitset, the rest are checked against ranges
+const int numberBitsetSize = 64;
+
+// dynamically built patterns (e.g. with card ids) would make the cache grow forever
+const int maxCachedPatterns = 4096;
+}
+
+class ExpPatternPrivate
 {
-    return exp;
+public:
+    struct NameFactor
+    {
+        bool any;
+        bool positive;
+        int kind;
+        bool isObjectName;
+        QString objectName;
+        bool isId;
+        int id;
+    };
+
+    enum PlaceType
+    {
+        Equipped,
+        Hand,
+        OtherPlayerPile,
+        Pile
+    };
+
+    struct Place
+    {
+        PlaceType type;
+        QString pile;
+        Atom pileAtom;
+    };
+
+    // one '$' separated alternative
+    struct Term
+    {
+        // ',' separated options of '+' joined factors
+        QVector<QVector<NameFactor> > names;
+
+        bool hasSuit;
+        int suitMask;
+
+        bool hasNumber;
+        bool anyNumber;
+        quint64 numberMask;
+        QVector<QPair<int, int> > numberRanges;
+
+        bool hasPlace;
+        bool anyPlace;
+        QVector<Place> places;
+    };
+
+    QVector<Term> terms;
+
+    static ExpPatternPrivate *compile(const QString &exp);
+    static Term compileTerm(const QString &exp);
+    static void addNumberRange(Term &term, int from, int to);
+
+    static bool matchTerm(const Term &term, const Player *player, const Card *card);
+    static bool matchPlace(const Term &term, const Player *player, const Card *card);
+};
+
+namespace {
+typedef QHash<QString, QSharedPointer<const ExpPatternPrivate> > PatternCache;
+PatternCache patternCache;
+QReadWriteLock patternCacheLock;
+// After freezeCache(), the patterns compiled so far (those of the packages) are read from this copy without the lock,
+// and the others are compiled and cached by each thread on its own
+PatternCache frozenPatternCache;
+QAtomicInt patternCacheFrozen;
+QThreadStorage<PatternCache> localPatternCache;
+}
+
+ExpPatternPrivate *ExpPatternPrivate::compile(const QString &exp)
+{
+    ExpPatternPrivate *d = new ExpPatternPrivate;
+    foreach (const QString &oneExp, exp.split(QStringLiteral("$")))
+        d->terms << compileTerm(oneExp);
+
+    return d;
 }
 
 // '|' means 'and', '$' means 'or'.
-// the expression splited by '|' has 3 parts,
+// the expression splited by '|' has 4 parts,
 // 1st part means the card name, and ',' means more than one options.
 // 2nd patt means the card suit, and ',' means more than one options.
 // 3rd part means the card number, and ',' means more than one options,
 // the number uses '~' to make a scale for valid expressions
-bool ExpPattern::matchOne(const Player *player, const Card *card, QString exp) const
+// 4th part means the place of the card, and ',' means more than one options.
+ExpPatternPrivate::Term ExpPatternPrivate::compileTerm(const QString &exp)
 {
     QStringList factors = exp.split(QStringLiteral("|"));
+    Term term;
 
-    bool checkpoint = false;
-    QStringList card_types = factors.at(0).split(QStringLiteral(","));
-    foreach (const QString &or_name, card_types) {
-        checkpoint = false;
-        QStringList orNameSplit = or_name.split(QStringLiteral("+"));
-        foreach (const QString &_name, orNameSplit) {
-            QString name = _name;
-            if (name == QStringLiteral(".")) {
-                checkpoint = true;
-            } else {
-                bool isInt = false;
-                bool positive = true;
+    foreach (const QString &or_name, factors.at(0).split(QStringLiteral(","))) {
+        QVector<NameFactor> option;
+        foreach (const QString &_name, or_name.split(QStringLiteral("+"))) {
+            NameFactor factor;
+            factor.any = (_name == QStringLiteral("."));
+            factor.positive = true;
+            factor.isObjectName = false;
+            factor.kind = -1;
+            factor.isId = false;
+            factor.id = 0;
+            if (!factor.any) {
+                QString name = _name;
                 if (name.startsWith(QStringLiteral("^"))) {
-                    positive = false;
+                    factor.positive = false;
                     name = name.mid(1);
                 }
-                if (card->cardFace()->isKindOf(name.toUtf8().data()) || (QStringLiteral("%") + card->cardFace()->objectName() == name) || (card->effectiveId() == name.toInt(&isInt) && isInt))
-                    checkpoint = positive;
-                else
-                    checkpoint = !positive;
+                factor.id = name.toInt(&factor.isId);
+                if (name.startsWith(QStringLiteral("%"))) {
+                    factor.isObjectName = true;
+                    factor.objectName = name.mid(1);
+                } else if (!factor.isId) {
+                    // neither object names nor card ids can be class names, keep them out of the kind table
+                    factor.kind = CardFace::kindId(name.toUtf8().constData());
+                }
             }
-            if (!checkpoint)
+            option << factor;
+        }
+        term.names << option;
+    }
+
+    // the first matched option decides, so all of them can be merged into one mask
+    term.hasSuit = factors.size() >= 2;
+    term.suitMask = 0;
+    if (term.hasSuit) {
+        foreach (const QString &_suit, factors.at(1).split(QStringLiteral(","))) {
+            if (_suit == QStringLiteral(".")) {
+                term.suitMask = AllSuitBits;
                 break;
+            }
+            if (_suit.startsWith(QStringLiteral("^")))
+                term.suitMask |= AllSuitBits & ~suitBits(_suit.mid(1));
+            else
+                term.suitMask |= suitBits(_suit);
         }
-        if (checkpoint)
-            break;
     }
-    if (!checkpoint)
-        return false;
-    if (factors.size() < 2)
-        return true;
 
-    checkpoint = false;
-    QStringList card_suits = factors.at(1).split(QStringLiteral(","));
-    foreach (const QString &_suit, card_suits) {
-        QString suit = _suit;
-        if (suit == QStringLiteral(".")) {
-            checkpoint = true;
-            break;
+    term.hasNumber = factors.size() >= 3;
+    term.anyNumber = false;
+    term.numberMask = 0;
+    if (term.hasNumber) {
+        foreach (const QString &number, factors.at(2).split(QStringLiteral(","))) {
+            if (number == QStringLiteral(".")) {
+                term.anyNumber = true;
+                break;
+            }
+
+            bool isInt = false;
+            if (number.contains(QStringLiteral("~"))) {
+                QStringList params = number.split(QStringLiteral("~"));
+                int from, to;
+                if (!params.at(0).size())
+                    from = 1;
+                else
+                    from = params.at(0).toInt();
+                if (!params.at(1).size())
+                    to = 13;
+                else
+                    to = params.at(1).toInt();
+
+                addNumberRange(term, from, to);
+            } else {
+                int n = number.toInt(&isInt);
+                if (!isInt) {
+                    if (number == QStringLiteral("A"))
+                        n = 1;
+                    else if (number == QStringLiteral("J"))
+                        n = 11;
+                    else if (number == QStringLiteral("Q"))
+                        n = 12;
+                    else if (number == QStringLiteral("K"))
+                        n = 13;
+                    else
+                        continue;
+                }
+                addNumberRange(term, n, n);
+            }
         }
-        bool positive = true;
-        if (suit.startsWith(QStringLiteral("^"))) {
-            positive = false;
-            suit = suit.mid(1);
+    }
+
+    term.hasPlace = factors.size() >= 4;
+    term.anyPlace = term.hasPlace && factors.at(3) == QStringLiteral(".");
+    if (term.hasPlace && !term.anyPlace) {
+        foreach (const QString &p, factors.at(3).split(QStringLiteral(","))) {
+            Place place;
+            if (p == QStringLiteral("equipped")) {
+                place.type = Equipped;
+            } else if (p == QStringLiteral("hand")) {
+                place.type = Hand;
+            } else if (p.startsWith(QStringLiteral("%"))) {
+                place.type = OtherPlayerPile;
+                place.pile = p.mid(1);
+            } else {
+                place.type = Pile;
+                place.pile = p;
+                place.pileAtom = Atom(p);
+            }
+            term.places << place;
         }
-        if (card->suitString() == suit || (card->isBlack() && suit == QStringLiteral("black")) || (card->isRed() && suit == QStringLiteral("red")))
-            checkpoint = positive;
-        else
-            checkpoint = !positive;
-        if (checkpoint)
-            break;
     }
-    if (!checkpoint)
-        return false;
-    if (factors.size() < 3)
-        return true;
 
-    checkpoint = false;
-    QStringList card_numbers = factors.at(2).split(QStringLiteral(","));
-    int cdn = card->number();
+    return term;
+}
 
-    foreach (const QString &number, card_numbers) {
-        if (number == QStringLiteral(".")) {
-            checkpoint = true;
-            break;
-        }
+void ExpPatternPrivate::addNumberRange(Term &term, int from, int to)
+{
+    for (int i = qMax(from, 0); i <= to && i < numberBitsetSize; ++i)
+        term.numberMask |= Q_UINT64_C(1) << i;
 
-        bool isInt = false;
-        if (number.contains(QStringLiteral("~"))) {
-            QStringList params = number.split(QStringLiteral("~"));
-            int from, to;
-            if (!params.at(0).size())
-                from = 1;
-            else
-                from = params.at(0).toInt();
-            if (!params.at(1).size())
-                to = 13;
-            else
-                to = params.at(1).toInt();
+    if (from < 0 || to >= numberBitsetSize)
+        term.numberRanges << qMakePair(from, to);
+}
 
-            if (from <= cdn && cdn <= to)
+bool ExpPatternPrivate::matchTerm(const Term &term, const Player *player, const Card *card)
+{
+    bool checkpoint = false;
+    foreach (const QVector<NameFactor> &option, term.names) {
+        checkpoint = false;
+        foreach (const NameFactor &factor, option) {
+            if (factor.any) {
                 checkpoint = true;
-        } else if (number.toInt(&isInt) == cdn && isInt)
-            checkpoint = true;
-        else if ((number == QStringLiteral("A") && cdn == 1) || (number == QStringLiteral("J") && cdn == 11) || (number == QStringLiteral("Q") && cdn == 12) || (number == QStringLiteral("K") && cdn == 13))
-            checkpoint = true;
+            } else {
+                const CardFace *face = card->cardFace();
+                bool matched = face->isKindOfId(factor.kind)
+                    || (factor.isObjectName && face->objectName() == factor.objectName)
+                    || (factor.isId && card->effectiveId() == factor.id);
+                checkpoint = (matched == factor.positive);
+            }
+            if (!checkpoint)
+                break;
+        }
         if (checkpoint)
             break;
     }
     if (!checkpoint)
         return false;
-    if (factors.size() < 4)
+    if (!term.hasSuit)
         return true;
 
-    checkpoint = false;
-    QString place = factors.at(3);
-    if (!player || place == QStringLiteral("."))
-        checkpoint = true;
-    if (!checkpoint) {
-        QList<const Card *> cards;
-        if (card->isVirtualCard())
-            cards = card->subcards();
-        else
-            cards << card;
-        if (!cards.isEmpty()) {
-            foreach (const Card *card, cards) {
-                checkpoint = false;
-                QStringList placeSplit = place.split(QStringLiteral(","));
-                foreach (const QString &_p, placeSplit) {
-                    QString p = _p;
-                    if (p == QStringLiteral("equipped") && player->hasEquip(card)) {
-                        checkpoint = true;
-                    } else if (p == QStringLiteral("hand") && card->effectiveId() >= 0) {
-                        foreach (const Card *c, player->handcards()) {
-                            if (c == card) {
-                                checkpoint = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if (p.startsWith(QStringLiteral("%"))) {
-                            p = p.mid(1);
-//                            foreach (const Player *pl, player->getAliveSiblings()) {
-//                                if (!pl->pile(p).isEmpty() && pl->pile(p).contains(card)) {
-//                                    checkpoint = true;
-//                                    break;
-//                                }
-//                            }
-                        } else if (!player->pile(p).isEmpty() && player->pile(p).contains(card)) {
-                            checkpoint = true;
-                        }
-                    }
-                    if (checkpoint)
-                        break;
-                }
-                if (!checkpoint)
+    if ((term.suitMask & suitBit(card->suit())) == 0)
+        return false;
+    if (!term.hasNumber)
+        return true;
+
+    if (!term.anyNumber) {
+        int cdn = card->number();
+        if (cdn >= 0 && cdn < numberBitsetSize) {
+            if ((term.numberMask & (Q_UINT64_C(1) << cdn)) == 0)
+                return false;
+        } else {
+            checkpoint = false;
+            typedef QPair<int, int> Range;
+            foreach (const Range &range, term.numberRanges) {
+                if (range.first <= cdn && cdn <= range.second) {
+                    checkpoint = true;
                     break;
+                }
+            }
+            if (!checkpoint)
+                return false;
+        }
+    }
+    if (!term.hasPlace)
+        return true;
+
+    if (!player || term.anyPlace)
+        return true;
+
+    QList<const Card *> cards;
+    if (card->isVirtualCard())
+        cards = card->subcards();
+    else
+        cards << card;
+    if (cards.isEmpty())
+        return false;
+
+    foreach (const Card *c, cards) {
+        if (!matchPlace(term, player, c))
+            return false;
+    }
+    return true;
+}
+
+bool ExpPatternPrivate::matchPlace(const Term &term, const Player *player, const Card *card)
+{
+    foreach (const Place &place, term.places) {
+        switch (place.type) {
+            case Equipped:
+                if (player->hasEquip(card))
+                    return true;
+                break;
+            case Hand:
+                if (card->effectiveId() >= 0) {
+                    const RoomObject *room = player->roomObject();
+                    if (room != nullptr ? room->isCardInHand(card->id(), player) : player->handcards().contains(card))
+                        return true;
+                }
+                break;
+            case OtherPlayerPile:
+                // piles of other players are not searched yet
+                break;
+            case Pile: {
+                const RoomObject *room = player->roomObject();
+                if (room != nullptr) {
+                    RoomObject::CardPlaceStruct p = room->cardPlace(card);
+                    if (p.player == player && p.place == QSgsEnum::CardPlace::OutOfGame && p.pile == place.pileAtom)
+                        return true;
+                } else if (player->pile(place.pile).contains(card)) {
+                    return true;
+                }
+                break;
             }
         }
     }
-    return checkpoint;
+    return false;
 }
 
+ExpPattern::ExpPattern(const QString &exp)
+{
+    this->exp = exp;
+
+    if (patternCacheFrozen.loadAcquire()) {
+        d = frozenPatternCache.value(exp);
+        if (d.isNull()) {
+            PatternCache &local = localPatternCache.localData();
+            d = local.value(exp);
+            if (d.isNull()) {
+                if (local.size() >= maxCachedPatterns)
+                    local.clear();
+                d = QSharedPointer<const ExpPatternPrivate>(ExpPatternPrivate::compile(exp));
+                local.insert(exp, d);
+            }
+        }
+        return;
+    }
+
+    {
+        QReadLocker l(&patternCacheLock);
+        d = patternCache.value(exp);
+    }
+    if (d.isNull()) {
+        QSharedPointer<const ExpPatternPrivate> compiled(ExpPatternPrivate::compile(exp));
+        QWriteLocker l(&patternCacheLock);
+        d = patternCache.value(exp);
+        if (d.isNull()) {
+            if (patternCache.size() >= maxCachedPatterns)
+                patternCache.clear();
+            patternCache.insert(exp, compiled);
+            d = compiled;
+        }
+    }
+}
+
+void ExpPattern::freezeCache()
+{
+    QWriteLocker l(&patternCacheLock);
+    if (patternCacheFrozen.load())
+        return;
+
+    frozenPatternCache = patternCache;
+    patternCacheFrozen.storeRelease(1);
+}
+
+bool ExpPattern::match(const Player *player, const Card *card) const
+{
+    foreach (const ExpPatternPrivate::Term &term, d->terms)
+        if (ExpPatternPrivate::matchTerm(term, player, card)) return true;
+
+    return false;
+}
+
+const QString &ExpPattern::getPatternString() const
+{
+    return exp;
+}
@@ -22,8 +22,12 @@
 #define _EXPPATTERN_H
 
 #include "libqsgsgamelogicglobal.h"
+
+#include <QSharedPointer>
+
 class Player;
 class Card;
+class ExpPatternPrivate;
 
 class LIBQSGSGAMELOGIC_EXPORT ExpPattern
 {
@@ -32,9 +36,13 @@ public:
     bool match(const Player *player, const Card *card) const;
     const QString &getPatternString() const;
 
+    // see GameLogicCore::freeze()
+    static void freezeCache();
+
 private:
     QString exp;
-    bool matchOne(const Player *player, const Card *card, QString exp) const;
+    // compiled once per pattern string and shared by every ExpPattern of it
+    QSharedPointer<const ExpPatternPrivate> d;
 };
 
 #endif
@@ -67,6 +67,12 @@ const QString &General::name() const
     return d->name;
 }
 
+const QString &General::kingdom() const
+{
+    Q_D(const General);
+    return d->kingdom;
+}
+
 bool General::isLord() const
 {
     Q_D(const General);
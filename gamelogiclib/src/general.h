@@ -39,6 +39,7 @@ public:
 
     QSgsPackage *package() const;
     const QString &name() const;
+    const QString &kingdom() const;
 
     bool isLord() const;
     bool isMale() const;
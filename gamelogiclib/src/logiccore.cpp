@@ -1,6 +1,10 @@
 
 #include "logiccore.h"
 #include "package.h"
+#include "atom.h"
+#include "cardcatalog.h"
+#include "cardface.h"
+#include "exppattern.h"
 
 class GameLogicCorePrivate
 {
@@ -11,16 +15,20 @@ public:
 
     QHash<QString, const QSgsPackage *> packages;
     QList<Card *> cards;
+    CardCatalog cardCatalog;
     QHash<QString, const CardFace *> cardFaces;
+
+    QAtomicInt frozen;
 };
 
 GameLogicCore *GameLogicCore::instance()
 {
-    static GameLogicCore *core = nullptr;
-    if (core == nullptr) {
-        core = new GameLogicCore;
-        connect(qApp, &QCoreApplication::aboutToQuit, core, &GameLogicCore::deleteLater);
-    }
+    // initialization of a function-local static is thread safe
+    static GameLogicCore *core = []() {
+        GameLogicCore *c = new GameLogicCore;
+        connect(qApp, &QCoreApplication::aboutToQuit, c, &GameLogicCore::deleteLater);
+        return c;
+    }();
 
     return core;
 }
@@ -47,6 +55,11 @@ bool GameLogicCore::addPackage(QSgsPackage *package)
 
     Q_D(GameLogicCore);
 
+    if (d->frozen.loadAcquire()) {
+        qDebug() << QStringLiteral("Package %1 is added after the first room is created").arg(package->name());
+        return false;
+    }
+
     // sanity check
     if (d->packages.contains(package->name())) {
         qDebug() << QStringLiteral("Duplicate package") << package->name();
@@ -76,21 +89,49 @@ bool GameLogicCore::addPackage(QSgsPackage *package)
 
     d->packages[package->name()] = package;
 
-    for (auto i = package->cardFaces().cbegin(), e = package->cardFaces().cend(); i != e; ++i)
+    // intern the names here so that the atoms of them are ready before any game starts
+    for (auto i = package->cardFaces().cbegin(), e = package->cardFaces().cend(); i != e; ++i) {
         d->cardFaces[i.key()] = i.value();
+        Atom(i.key());
+    }
 
-    for (auto i = package->generals().cbegin(), e = package->generals().cend(); i != e; ++i)
+    for (auto i = package->generals().cbegin(), e = package->generals().cend(); i != e; ++i) {
         d->generals[i.key()] = i.value();
+        Atom(i.key());
+    }
 
-    for (auto i = package->skills().cbegin(), e = package->skills().cend(); i != e; ++i)
+    for (auto i = package->skills().cbegin(), e = package->skills().cend(); i != e; ++i) {
         d->skills[i.key()] = i.value();
+        Atom(i.key());
+    }
 
     for (auto i = package->relatedSkills().cbegin(), e = package->relatedSkills().cend(); i != e; ++i)
         d->relatedSkills.insertMulti(i.key(), i.value());
 
+    foreach (Card *card, package->cards()) {
+        d->cards << card;
+        d->cardCatalog.append(card);
+    }
+
     return true;
 }
 
+void GameLogicCore::freeze()
+{
+    Q_D(GameLogicCore);
+    if (d->frozen.loadAcquire())
+        return;
+
+    // resolves the kinds of every face, so their class names are in the frozen kind table
+    foreach (const CardFace *face, d->cardFaces)
+        face->isKindOfId(0);
+
+    Atom::freeze();
+    CardFace::freezeKinds();
+    ExpPattern::freezeCache();
+    d->frozen.storeRelease(1);
+}
+
 QList<const QSgsPackage *> GameLogicCore::packages() const
 {
     Q_D(const GameLogicCore);
@@ -149,6 +190,12 @@ const QList<Card *> &GameLogicCore::cards() const
     return d->cards;
 }
 
+const CardCatalog &GameLogicCore::cardCatalog() const
+{
+    Q_D(const GameLogicCore);
+    return d->cardCatalog;
+}
+
 const CardFace *GameLogicCore::cardFace(const QString &name) const
 {
     Q_D(const GameLogicCore);
@@ -4,6 +4,7 @@
 #include "libqsgsgamelogicglobal.h"
 
 class Card;
+class CardCatalog;
 class CardFace;
 class QSgsPackage;
 class Skill;
@@ -20,7 +21,12 @@ public:
     static GameLogicCore *instance();
     ~GameLogicCore();
     
+    // all packages should be added before any room is created
+    // after that, the core is only read and can be used from all threads at the same time
     bool addPackage(QSgsPackage *package);
+    // Freezes the tables of atoms, card kinds and compiled patterns filled by the packages, so that they are read
+    // without any lock by the games. Called when a room is created, and no package can be added after it
+    void freeze();
     QList<const QSgsPackage *> packages() const;
 
     const General *general(const QString &name) const;
@@ -33,6 +39,8 @@ public:
     QList<const Skill *> relatedSkills(const Skill *mainSkill) const;
 
     const QList<Card *> &cards() const;
+    // the cards above, stored in a compact form for creating rooms, the catalog id of a card is its index in cards() + 1
+    const CardCatalog &cardCatalog() const;
 
 
     const CardFace *cardFace(const QString &name) const;
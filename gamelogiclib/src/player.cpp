@@ -19,23 +19,37 @@
     *********************************************************************/
 
 #include "player.h"
+#include "roomobject.h"
+#include "logiccore.h"
+#include "general.h"
+#include "skill.h"
+#include "../cardfaces/base.h"
 #include <QSgsCore/QSgsEngine>
 
-class PlayerPrivate
+#include <QEvent>
+
+class PlayerPrivate : public QSharedData
 {
 public:
-    QMap<QString, int> marks;
-    QMap<QString, QList<Card *> > piles;
-    QMap<QString, QStringList> pileOpen;
-    QSet<QString> headAcquiredSkills;
-    QSet<QString> deputyAcquiredSkills;
-    QMap<QString, bool> headSkills;
-    QMap<QString, bool> deputySkills;
-    QSet<QString> flags;
-    QHash<QString, int> history;
+    QHash<Atom, int> marks;
+    // marks and flags whose names are not fixed atoms, see Atom::fixed()
+    QHash<QString, int> dynamicMarks;
+    QSet<QString> dynamicFlags;
+    QHash<Atom, QList<Card *> > piles;
+    QHash<Atom, QStringList> pileOpen;
+    QSet<Atom> headAcquiredSkills;
+    QSet<Atom> deputyAcquiredSkills;
+    QHash<Atom, bool> headSkills;
+    QHash<Atom, bool> deputySkills;
+    QSet<Atom> flags;
+    QHash<Atom, int> history;
 
     QStringList delayedEffects;
 
+    QList<Card *> handcards;
+    QList<Card *> equips;
+    QList<Card *> judgingCards;
+
     const General *general;
     const General *general2;
 
@@ -79,6 +93,11 @@ public:
     bool scenarioRoleShown;
 };
 
+namespace {
+// interned when the library is loaded, so it is a fixed atom, see Atom::fixed()
+const Atom infinityAttackRange(QStringLiteral("InfinityAttackRange"));
+}
+
 Player::Player(QObject *parent)
     : QObject(parent), d_ptr(new PlayerPrivate)
 {
@@ -93,8 +112,35 @@ Player::Player(QObject *parent)
 
 Player::~Player()
 {
-    Q_D(Player);
-    delete d;
+}
+
+PlayerState::PlayerState()
+{
+}
+
+PlayerState::PlayerState(const PlayerState &other)
+    : d(other.d)
+{
+}
+
+PlayerState &PlayerState::operator=(const PlayerState &other)
+{
+    d = other.d;
+    return *this;
+}
+
+PlayerState::~PlayerState()
+{
+}
+
+bool PlayerState::isNull() const
+{
+    return d.constData() == nullptr;
+}
+
+RoomObject *Player::roomObject() const
+{
+    return qobject_cast<RoomObject *>(parent());
 }
 
 int Player::hp() const
@@ -107,6 +153,7 @@ void Player::setHp(int hp)
 {
     Q_D(Player);
     d->hp = hp;
+    invalidateModifiers();
 }
 
 int Player::maxHp() const
@@ -119,6 +166,7 @@ void Player::setMaxHp(int maxHp)
 {
     Q_D(Player);
     d->maxHp = maxHp;
+    invalidateModifiers();
 }
 
 int Player::lostHp() const
@@ -214,32 +262,56 @@ void Player::setKingdom(const QString &kingdom)
 {
     Q_D(Player);
     d->kingdom = kingdom;
+    // relations between players, and the skills of the same kingdom, depend on it
+    invalidateModifiers();
 }
 
 void Player::setGeneral(const General *general)
 {
     Q_D(Player);
     d->general = general;
+    if (general != nullptr && d->kingdom.isEmpty())
+        d->kingdom = general->kingdom();
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 void Player::setGeneralName(const QString &general_name)
 {
-
+    setGeneral(GameLogicCore::instance()->general(general_name));
 }
 
 const QString &Player::generalName() const
 {
-    return QString();
+    Q_D(const Player);
+    static const QString empty;
+    return d->general == nullptr ? empty : d->general->name();
 }
 
-void Player::setGeneral2Name(const QString &general_name)
+const General *Player::general() const
 {
+    Q_D(const Player);
+    return d->general;
+}
+
+void Player::setGeneral2(const General *general)
+{
+    Q_D(Player);
+    d->general2 = general;
+    invalidateModifiers();
+    invalidateTriggerSkills();
+}
 
+void Player::setGeneral2Name(const QString &general_name)
+{
+    setGeneral2(GameLogicCore::instance()->general(general_name));
 }
 
 const QString &Player::general2Name() const
 {
-    return QString();
+    Q_D(const Player);
+    static const QString empty;
+    return d->general2 == nullptr ? empty : d->general2->name();
 }
 
 const General *Player::general2() const
@@ -270,6 +342,8 @@ void Player::setSeat(int seat)
 {
     Q_D(Player);
     d->seat = seat;
+    invalidateDistances();
+    invalidateModifiers();
 }
 
 bool Player::isAdjacentTo(const Player *another) const
@@ -297,16 +371,50 @@ void Player::setPhase(QSgsEnum::PlayerPhase phase)
 {
     Q_D(Player);
     d->phase = phase;
+    invalidateModifiers();
 }
 
 int Player::attackRange(bool include_weapon) const
 {
-    return 0;
+    if (hasFlag(infinityAttackRange) || mark(infinityAttackRange) > 0)
+        return 1000;
+
+    Q_D(const Player);
+    include_weapon = include_weapon && d->weapon != nullptr;
+
+    RoomObject *room = roomObject();
+    if (room != nullptr) {
+        int fixeddis = room->correctAttackRange(this, include_weapon, true);
+        if (fixeddis > 0)
+            return fixeddis;
+    }
+
+    int original_range = 1, weapon_range = 0;
+
+    if (include_weapon) {
+        const Weapon *face = qobject_cast<const Weapon *>(d->weapon->cardFace());
+        if (face != nullptr)
+            weapon_range = face->range();
+    }
+
+    int real_range = qMax(original_range, weapon_range);
+    if (room != nullptr)
+        real_range += room->correctAttackRange(this, include_weapon, false);
+
+    return qMax(real_range, 0);
 }
 
 bool Player::inMyAttackRange(const Player *other) const
 {
-    return false;
+    int distance = distanceTo(other);
+    if (distance == -1)
+        return false;
+
+    QStringList in_attack_range_players = property("in_my_attack_range").toString().split(QStringLiteral("+"));
+    if (in_attack_range_players.contains(other->objectName())) // for DIY Skills
+        return true;
+
+    return distance <= attackRange();
 }
 
 bool Player::isAlive() const
@@ -325,31 +433,80 @@ void Player::setAlive(bool alive)
 {
     Q_D(Player);
     d->alive = alive;
+    invalidateDistances();
+    invalidateModifiers();
 }
 
 QString Player::flags() const
 {
-    return QString();
+    return flagList().join(QStringLiteral("|"));
 }
 
 QStringList Player::flagList() const
 {
-    return QStringList();
+    Q_D(const Player);
+    QStringList l;
+    foreach (const Atom &flag, d->flags)
+        l << flag.name();
+    foreach (const QString &flag, d->dynamicFlags)
+        l << flag;
+
+    return l;
 }
 
 void Player::setFlag(const QString &flag)
 {
+    Q_D(Player);
+    if (flag == QStringLiteral(".")) {
+        clearFlags();
+        return;
+    }
 
+    static QChar unset_symbol = QChar::fromLatin1('-');
+    if (flag.startsWith(unset_symbol)) {
+        QString name = flag.mid(1);
+        Atom copy = Atom::fixed(name);
+        if (!copy.isNull())
+            d->flags.remove(copy);
+        else
+            d->dynamicFlags.remove(name);
+    } else {
+        Atom atom = Atom::fixed(flag);
+        if (!atom.isNull())
+            d->flags.insert(atom);
+        else
+            d->dynamicFlags.insert(flag);
+    }
+    invalidateModifiers();
 }
 
 bool Player::hasFlag(const QString &flag) const
 {
-    return false;
+    Q_D(const Player);
+    Atom atom = Atom::fixed(flag);
+    if (!atom.isNull())
+        return d->flags.contains(atom);
+
+    return d->dynamicFlags.contains(flag);
 }
 
-void Player::clearFlags()
+bool Player::hasFlag(Atom flag) const
 {
+    Q_D(const Player);
+    if (flag.isNull())
+        return false;
+    if (flag.isFixed())
+        return d->flags.contains(flag);
 
+    return d->dynamicFlags.contains(flag.name());
+}
+
+void Player::clearFlags()
+{
+    Q_D(Player);
+    d->flags.clear();
+    d->dynamicFlags.clear();
+    invalidateModifiers();
 }
 
 bool Player::faceUp() const
@@ -362,21 +519,80 @@ void Player::setFaceUp(bool faceUp)
 {
     Q_D(Player);
     d->faceUp = faceUp;
+    invalidateModifiers();
 }
 
 void Player::setFixedDistance(const Player *player, int distance)
 {
-
+    Q_D(Player);
+    if (distance == -1)
+        d->fixedDistance.remove(player);
+    else
+        d->fixedDistance.insert(player, distance);
 }
 
 int Player::originalRightDistanceTo(const Player *other) const
 {
-    return 0;
+    RoomObject *room = roomObject();
+    if (room == nullptr)
+        return 0;
+
+    return room->rightDistance(this, other);
 }
 
 int Player::distanceTo(const Player *other, int distance_fix) const
 {
-    return 0;
+    Q_D(const Player);
+    if (this == other || isDead() || other->isDead())
+        return 0;
+
+    if (isRemoved() || other->isRemoved())
+        return -1;
+
+    if (d->fixedDistance.contains(other))
+        return d->fixedDistance.value(other);
+
+    RoomObject *room = roomObject();
+    if (room == nullptr)
+        return 0;
+
+    int distance = room->seatDistance(this, other) + distance_fix;
+
+    // keep the distance >=1
+    if (distance < 1)
+        distance = 1;
+
+    return distance;
+}
+
+void Player::invalidateDistances()
+{
+    RoomObject *room = roomObject();
+    if (room != nullptr)
+        room->invalidateDistances();
+}
+
+void Player::invalidateModifiers()
+{
+    RoomObject *room = roomObject();
+    if (room != nullptr)
+        room->invalidateModifiers(this);
+}
+
+bool Player::event(QEvent *event)
+{
+    // modifier skills may read dynamic properties, see RoomObject::invalidateModifiers()
+    if (event->type() == QEvent::DynamicPropertyChange)
+        invalidateModifiers();
+
+    return QObject::event(event);
+}
+
+void Player::invalidateTriggerSkills()
+{
+    RoomObject *room = roomObject();
+    if (room != nullptr)
+        room->invalidateTriggerSkills();
 }
 
 bool Player::isLord() const
@@ -386,27 +602,53 @@ bool Player::isLord() const
 
 void Player::acquireSkill(const QString &skill_name, bool head)
 {
-
+    Q_D(Player);
+    QSet<Atom> &skills = head ? d->headAcquiredSkills : d->deputyAcquiredSkills;
+    skills.insert(Atom(skill_name));
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 void Player::detachSkill(const QString &skill_name)
 {
-
+    Q_D(Player);
+    Atom skill = Atom::lookup(skill_name);
+    d->headAcquiredSkills.remove(skill);
+    d->deputyAcquiredSkills.remove(skill);
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 void Player::detachAllSkills()
 {
-
+    Q_D(Player);
+    d->headAcquiredSkills.clear();
+    d->deputyAcquiredSkills.clear();
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 void Player::addSkill(const QString &skill_name, bool head_skill)
 {
-
+    Q_D(Player);
+    const Skill *skill = GameLogicCore::instance()->skill(skill_name);
+    Q_ASSERT(skill);
+    if (head_skill)
+        d->headSkills[Atom(skill_name)] = !skill->canPreshow() || d->general1Showed;
+    else
+        d->deputySkills[Atom(skill_name)] = !skill->canPreshow() || d->general2Showed;
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 void Player::loseSkill(const QString &skill_name)
 {
-
+    Q_D(Player);
+    Atom skill = Atom::lookup(skill_name);
+    d->headSkills.remove(skill);
+    d->deputySkills.remove(skill);
+    invalidateModifiers();
+    invalidateTriggerSkills();
 }
 
 bool Player::hasSkill(const QString &skill_name, bool include_lose) const
@@ -452,22 +694,27 @@ void Player::setDelayedEffect(const QString &effectName)
 
 bool Player::hasEquip(const Card *card) const
 {
-    return false;
+    Q_D(const Player);
+    return d->equips.contains(const_cast<Card *>(card));
 }
 
 bool Player::hasEquip() const
 {
-    return false;
+    Q_D(const Player);
+    return !d->equips.isEmpty();
 }
 
-QList<const Card *> Player::judgingArea() const
+ConstListView<Card> Player::judgingArea() const
 {
-    return QList<const Card *>();
+    Q_D(const Player);
+    return ConstListView<Card>(d->judgingCards);
 }
 
 const QList<Card *> &Player::judgingArea()
 {
-    return QList<Card *>();
+    // read only, so the shared private data must not be detached
+    const PlayerPrivate *d = d_ptr.constData();
+    return d->judgingCards;
 }
 
 QList<int> Player::judgingAreaID() const
@@ -493,27 +740,67 @@ bool Player::containsTrick(const QString &trick_name) const
 
 int Player::handcardNum() const
 {
-    return false;
+    Q_D(const Player);
+    return d->handcards.length();
 }
 
 void Player::removeCard(Card *card, QSgsEnum::CardPlace place)
 {
-
+    Q_D(Player);
+    switch (place) {
+        case QSgsEnum::CardPlace::Hand:
+            d->handcards.removeOne(card);
+            // the number of handcards is a common condition of modifier skills
+            invalidateModifiers();
+            break;
+        case QSgsEnum::CardPlace::Equip:
+            d->equips.removeOne(card);
+            // horses change distances, and equip skills come and go with the equips
+            invalidateModifiers();
+            invalidateTriggerSkills();
+            break;
+        case QSgsEnum::CardPlace::Judge:
+            d->judgingCards.removeOne(card);
+            d->judgingArea.removeOne(card->id());
+            break;
+        default:
+            break;
+    }
 }
 
 void Player::addCard(Card *card, QSgsEnum::CardPlace place)
 {
-
+    Q_D(Player);
+    switch (place) {
+        case QSgsEnum::CardPlace::Hand:
+            d->handcards << card;
+            invalidateModifiers();
+            break;
+        case QSgsEnum::CardPlace::Equip:
+            d->equips << card;
+            invalidateModifiers();
+            invalidateTriggerSkills();
+            break;
+        case QSgsEnum::CardPlace::Judge:
+            d->judgingCards << card;
+            d->judgingArea << card->id();
+            break;
+        default:
+            break;
+    }
 }
 
-QList<const Card *> Player::handcards() const
+ConstListView<Card> Player::handcards() const
 {
-    return QList<const Card *>();
+    Q_D(const Player);
+    return ConstListView<Card>(d->handcards);
 }
 
 const QList<Card *> &Player::handcards()
 {
-    return QList<Card *>();
+    // read only, so the shared private data must not be detached
+    const PlayerPrivate *d = d_ptr.constData();
+    return d->handcards;
 }
 
 Card *Player::weapon() const
@@ -546,14 +833,17 @@ Card *Player::treasure() const
     return d->treasure;
 }
 
-QList<const Card *> Player::equips() const
+ConstListView<Card> Player::equips() const
 {
-    return QList<const Card *>();
+    Q_D(const Player);
+    return ConstListView<Card>(d->equips);
 }
 
 const QList<Card *> &Player::equips()
 {
-    return QList<Card *>();
+    // read only, so the shared private data must not be detached
+    const PlayerPrivate *d = d_ptr.constData();
+    return d->equips;
 }
 
 Card *Player::equip(int index) const
@@ -603,28 +893,68 @@ bool Player::canDiscard(const Player *to, int card_id) const
 
 void Player::addMark(const QString &mark, int add_num)
 {
-
+    Q_D(Player);
+    Atom atom = Atom::fixed(mark);
+    if (!atom.isNull())
+        d->marks[atom] += add_num;
+    else
+        d->dynamicMarks[mark] += add_num;
+    invalidateModifiers();
 }
 
 void Player::removeMark(const QString &mark, int remove_num)
 {
-
+    Q_D(Player);
+    Atom atom = Atom::fixed(mark);
+    if (!atom.isNull()) {
+        if (!d->marks.contains(atom))
+            return;
+        int &value = d->marks[atom];
+        value = qMax(0, value - remove_num);
+    } else {
+        if (!d->dynamicMarks.contains(mark))
+            return;
+        int &value = d->dynamicMarks[mark];
+        value = qMax(0, value - remove_num);
+    }
+    invalidateModifiers();
 }
 
 void Player::setMark(const QString &mark, int value)
 {
-
+    Q_D(Player);
+    Atom atom = Atom::fixed(mark);
+    if (!atom.isNull())
+        d->marks[atom] = value;
+    else
+        d->dynamicMarks[mark] = value;
+    invalidateModifiers();
 }
 
 int Player::mark(const QString &mark) const
 {
-    return 0;
+    Q_D(const Player);
+    Atom atom = Atom::fixed(mark);
+    if (!atom.isNull())
+        return d->marks.value(atom, 0);
+
+    return d->dynamicMarks.value(mark, 0);
+}
+
+int Player::mark(Atom mark) const
+{
+    Q_D(const Player);
+    if (mark.isFixed())
+        return d->marks.value(mark, 0);
+
+    return d->dynamicMarks.value(mark.name(), 0);
 }
 
 void Player::setChained(bool chained)
 {
     Q_D(Player);
     d->chained = chained;
+    invalidateModifiers();
 }
 
 bool Player::isChained() const
@@ -642,6 +972,8 @@ void Player::setRemoved(bool removed)
 {
     Q_D(Player);
     d->removed = removed;
+    invalidateDistances();
+    invalidateModifiers();
 }
 
 bool Player::isRemoved() const
@@ -687,7 +1019,15 @@ QStringList Player::pileNames() const
 
 QString Player::pileName(const Card *card) const
 {
-    return QString();
+    RoomObject *room = roomObject();
+    if (room == nullptr)
+        return QString();
+
+    RoomObject::CardPlaceStruct place = room->cardPlace(card);
+    if (place.player != this || place.place != QSgsEnum::CardPlace::OutOfGame)
+        return QString();
+
+    return place.pile.name();
 }
 
 QList<int> Player::handPile() const
@@ -712,22 +1052,33 @@ void Player::setPileOpen(const QString &pile_name, const QString &player)
 
 void Player::addHistory(const QString &name, int times)
 {
-
+    Q_D(Player);
+    d->history[Atom(name)] += times;
 }
 
 void Player::clearHistory(const QString &name)
 {
-
+    Q_D(Player);
+    if (name.isEmpty())
+        d->history.clear();
+    else
+        d->history.remove(Atom::lookup(name));
 }
 
 bool Player::hasUsed(const QString &card_class) const
 {
-    return false;
+    return usedTimes(card_class) > 0;
 }
 
 int Player::usedTimes(const QString &card_class) const
 {
-    return 0;
+    return usedTimes(Atom::lookup(card_class));
+}
+
+int Player::usedTimes(Atom card_class) const
+{
+    Q_D(const Player);
+    return d->history.value(card_class, 0);
 }
 
 int Player::slashCount() const
@@ -742,7 +1093,25 @@ bool Player::hasEquipSkill(const QString &skill_name) const
 
 QSet<const TriggerSkill *> Player::triggerSkills() const
 {
-    return QSet<const TriggerSkill *>();
+    Q_D(const Player);
+    QList<Atom> names = d->headSkills.keys() + d->deputySkills.keys() + d->headAcquiredSkills.toList() + d->deputyAcquiredSkills.toList();
+
+    GameLogicCore *core = GameLogicCore::instance();
+    QSet<const TriggerSkill *> skillList;
+    foreach (const Atom &name, names) {
+        const TriggerSkill *skill = qobject_cast<const TriggerSkill *>(core->skill(name.name()));
+        if (skill != nullptr)
+            skillList << skill;
+    }
+
+    // the skill of an equip is named after its face, and it's present as long as the equip is
+    foreach (const Card *equip, d->equips) {
+        const EquipSkill *skill = qobject_cast<const EquipSkill *>(core->skill(equip->cardFace()->objectName()));
+        if (skill != nullptr)
+            skillList << skill;
+    }
+
+    return skillList;
 }
 
 QSet<const Skill *> Player::skills(bool include_equip, bool visible_only) const
@@ -837,12 +1206,34 @@ const Player *Player::getLord(bool include_death) const
 
 void Player::copyFrom(Player *p)
 {
+    restoreState(p->saveState());
+}
 
+PlayerState Player::saveState() const
+{
+    PlayerState state;
+    state.d = d_ptr;
+    return state;
 }
 
-QList<const Player *> Player::siblings() const
+void Player::restoreState(const PlayerState &state)
 {
-    return QList<const Player *>();
+    if (state.isNull())
+        return;
+
+    d_ptr = state.d;
+    invalidateDistances();
+    invalidateModifiers();
+    invalidateTriggerSkills();
+}
+
+ConstListView<Player> Player::siblings() const
+{
+    RoomObject *room = roomObject();
+    if (room == nullptr)
+        return ConstListView<Player>();
+
+    return ConstListView<Player>(room->players(), this);
 }
 
 const QList<Player *> &Player::siblings()
@@ -956,12 +1347,16 @@ bool Player::hasShownGeneral2() const
 
 void Player::setGeneral1Showed(bool showed)
 {
-
+    Q_D(Player);
+    d->general1Showed = showed;
+    invalidateModifiers();
 }
 
 void Player::setGeneral2Showed(bool showed)
 {
-
+    Q_D(Player);
+    d->general2Showed = showed;
+    invalidateModifiers();
 }
 
 bool Player::hasShownOneGeneral() const
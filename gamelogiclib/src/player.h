@@ -23,13 +23,32 @@
 
 #include "libqsgsgamelogicglobal.h"
 #include "enumeration.h"
+#include "atom.h"
+#include "constlistview.h"
 
 class General;
 class Card;
 class Skill;
 class TriggerSkill;
+class RoomObject;
 class PlayerPrivate;
 
+// The state of a player, shared with the player until one of them is changed, see Player::saveState()
+class LIBQSGSGAMELOGIC_EXPORT PlayerState
+{
+public:
+    PlayerState();
+    PlayerState(const PlayerState &other);
+    PlayerState &operator=(const PlayerState &other);
+    ~PlayerState();
+
+    bool isNull() const;
+
+private:
+    friend class Player;
+    QSharedDataPointer<PlayerPrivate> d;
+};
+
 class LIBQSGSGAMELOGIC_EXPORT Player final : public QObject
 {
     Q_OBJECT
@@ -38,6 +57,9 @@ public:
     explicit Player(QObject *parent);
     ~Player();
 
+    // the RoomObject this player is in, nullptr if it is not in a room
+    RoomObject *roomObject() const;
+
     // property setters/getters
     int hp() const;
     void setHp(int hp);
@@ -60,7 +82,9 @@ public:
     void setGeneral(const General *general);
     void setGeneralName(const QString &general_name);
     const QString &generalName() const;
+    const General *general() const;
 
+    void setGeneral2(const General *general);
     void setGeneral2Name(const QString &general_name);
     const QString &general2Name() const;
     const General *general2() const;
@@ -87,6 +111,7 @@ public:
     QStringList flagList() const;
     void setFlag(const QString &flag);
     bool hasFlag(const QString &flag) const;
+    bool hasFlag(Atom flag) const;
     void clearFlags();
 
     bool faceUp() const;
@@ -118,7 +143,7 @@ public:
     bool hasEquip(const Card *card) const;
     bool hasEquip() const;
 
-    QList<const Card *> judgingArea() const;
+    ConstListView<Card> judgingArea() const;
     const QList<Card *> &judgingArea();
     QList<int> judgingAreaID() const;
     void addDelayedTrick(Card *trick);
@@ -126,9 +151,7 @@ public:
     bool containsTrick(const QString &trick_name) const;
 
     int handcardNum() const;
-    void removeCard(Card *card, QSgsEnum::CardPlace place);
-    void addCard(Card *card, QSgsEnum::CardPlace place);
-    QList<const Card *> handcards() const;
+    ConstListView<Card> handcards() const;
     const QList<Card *> &handcards();
 
     Card *weapon() const;
@@ -137,7 +160,7 @@ public:
     Card *offensiveHorse() const;
     Card *treasure() const;
 
-    QList<const Card *> equips() const;
+    ConstListView<Card> equips() const;
     const QList<Card *> &equips();
     Card *equip(int index) const;
 
@@ -156,6 +179,7 @@ public:
     void removeMark(const QString &mark, int remove_num = 1);
     void setMark(const QString &mark, int value);
     int mark(const QString &mark) const;
+    int mark(Atom mark) const;
 
     void setChained(bool chained);
     bool isChained() const;
@@ -185,9 +209,11 @@ public:
     void clearHistory(const QString &name = QString());
     bool hasUsed(const QString &card_class) const;
     int usedTimes(const QString &card_class) const;
+    int usedTimes(Atom card_class) const;
     int slashCount() const;
 
     bool hasEquipSkill(const QString &skill_name) const;
+    // the trigger skills of the generals, the acquired ones and the equip skills of the equips
     QSet<const TriggerSkill *> triggerSkills() const;
     QSet<const Skill *> skills(bool include_equip = false, bool visible_only = true) const;
     QList<const Skill *> skillList(bool include_equip = false, bool visible_only = true) const;
@@ -223,8 +249,12 @@ public:
     const Player *getLord(bool include_death = false) const; // a small function put here, simple but useful
 
     void copyFrom(Player *p);
+    // the state of a player is copied on write, so saving it only increases a reference count
+    // the state refers to the cards and the other players of the room, it is only meant to be restored in the same room
+    PlayerState saveState() const;
+    void restoreState(const PlayerState &state);
 
-    QList<const Player *> siblings() const;
+    ConstListView<Player> siblings() const;
     const QList<Player *> &siblings();
     QList<const Player *> aliveSiblings() const;
     const QList<Player *> &aliveSiblings();
@@ -273,11 +303,39 @@ public:
     QList<const Player *> formation() const;
     const QList<Player *> &formation();
 
+    // not tracked by the caches of the room, see RoomObject::invalidateModifiers()
     QVariantMap tag;
 
+private:
+    // RoomObject::moveCard() is the only way to move a card, it keeps the place of the card in the room
+    // (what ExpPattern and RoomObject::isCardInHand() look at) in step with the areas of the players
+    friend class RoomObject;
+    void removeCard(Card *card, QSgsEnum::CardPlace place);
+    void addCard(Card *card, QSgsEnum::CardPlace place);
+
+    // the ring of players depends on the seats, deaths and removals
+    void invalidateDistances();
+    // corrections of modifier skills depend on the generals, kingdom, skills, cards, marks, flags, hp, phase
+    // and the face-up and chained states
+    void invalidateModifiers();
+    void invalidateTriggerSkills();
+
 protected:
-    Q_DECLARE_PRIVATE(Player)
-    PlayerPrivate *d_ptr;
+    bool event(QEvent *event) override;
+
+    // not Q_DECLARE_PRIVATE, the private data is implicitly shared with the saved states and
+    // the non-const d_func() detaches it before it is changed, so only the mutators may use Q_D(Player).
+    // A non-const getter reads d_ptr.constData() instead
+    inline PlayerPrivate *d_func()
+    {
+        return d_ptr.data();
+    }
+    inline const PlayerPrivate *d_func() const
+    {
+        return d_ptr.constData();
+    }
+    friend class PlayerPrivate;
+    QSharedDataPointer<PlayerPrivate> d_ptr;
 };
 
 #endif
@@ -29,6 +29,54 @@
 #include <cmath>
 using namespace QSanProtocol;
 
+namespace {
+// A text record is "<elapsed> <json>\n".
+// A binary packet may contain newlines, so it is recorded as "<elapsed>#<length> <raw bytes>\n".
+struct RecordReader
+{
+    explicit RecordReader(const QByteArray &data)
+        : data(data)
+        , pos(0)
+    {
+    }
+
+    bool next(int *elapsed, QByteArray *cmd)
+    {
+        while (pos < data.length()) {
+            int header = pos;
+            while (header < data.length() && data.at(header) != ' ' && data.at(header) != '#')
+                ++header;
+            if (header >= data.length())
+                return false;
+
+            if (data.at(header) == '#') {
+                int space = data.indexOf(' ', header);
+                if (space == -1)
+                    return false;
+                int length = data.mid(header + 1, space - header - 1).toInt();
+                *elapsed = data.mid(pos, header - pos).toInt();
+                *cmd = data.mid(space + 1, length);
+                pos = space + 1 + length + 1;
+                return true;
+            }
+
+            int end = data.indexOf('\n', header);
+            if (end == -1)
+                end = data.length();
+            *elapsed = data.mid(pos, header - pos).toInt();
+            *cmd = data.mid(header + 1, end - header - 1);
+            pos = end + 1;
+            if (!cmd->isEmpty())
+                return true;
+        }
+        return false;
+    }
+
+    const QByteArray &data;
+    int pos;
+};
+}
+
 Recorder::Recorder(QObject *parent)
     : QObject(parent)
 {
@@ -41,6 +89,15 @@ void Recorder::recordLine(const QByteArray &line)
         return;
 
     data.append(QString::number(watch.elapsed()));
+    if (QSanProtocol::Packet::isBinary(line)) {
+        data.append('#');
+        data.append(QString::number(line.length()));
+        data.append(' ');
+        data.append(line);
+        data.append('\n');
+        return;
+    }
+
     data.append(' ');
     data.append(line);
     if (!line.endsWith('\n'))
@@ -64,7 +121,19 @@ bool Recorder::save(const QString &filename) const
 
 QList<QByteArray> Recorder::getRecords() const
 {
-    QList<QByteArray> records = data.split('\n');
+    QList<QByteArray> records;
+    RecordReader reader(data);
+    int elapsed = 0;
+    QByteArray cmd;
+    while (reader.next(&elapsed, &cmd)) {
+        if (QSanProtocol::Packet::isBinary(cmd)) {
+            QSanProtocol::Packet packet;
+            if (!packet.parse(cmd))
+                continue;
+            cmd = packet.toJson();
+        }
+        records << QByteArray::number(elapsed) + ' ' + cmd;
+    }
     return records;
 }
 
@@ -96,21 +165,16 @@ Replayer::Replayer(QObject *parent, const QString &filename)
     if (device == nullptr)
         return;
 
-    if (!device->open(QIODevice::ReadOnly | QIODevice::Text))
+    if (!device->open(QIODevice::ReadOnly))
         return;
 
-    while (!device->atEnd()) {
-        QByteArray line = device->readLine();
-        int split = line.indexOf(' ');
-
-        Pair pair;
-        pair.elapsed = line.left(split).toInt();
-        pair.cmd = line.mid(split + 1);
+    const QByteArray content = device->readAll();
+    delete device;
 
+    RecordReader reader(content);
+    Pair pair;
+    while (reader.next(&pair.elapsed, &pair.cmd))
         pairs << pair;
-    }
-
-    delete device;
 
     int time_offset = 0;
     pair_offset = 0;
@@ -1,5 +1,15 @@
 #include "roomobject.h"
 #include "player.h"
+#include "card.h"
+#include "skill.h"
+#include "logiccore.h"
+#include "cardcatalog.h"
+#include "simulation.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <limits>
 
 RoomRequestReceiver::RoomRequestReceiver()
 {
@@ -43,7 +53,7 @@ RoomRequestHandler::~RoomRequestHandler()
 
 void RoomRequestHandler::notifyReceiver(const QJsonDocument &request)
 {
-    m_receiver->doNotify(notify);
+    m_receiver->doNotify(request);
 }
 
 QJsonDocument RoomRequestHandler::requestReceiver(const QJsonDocument &request, int timeout)
@@ -58,32 +68,355 @@ RoomRequestReceiver *RoomRequestHandler::receiver() const
     return m_receiver;
 }
 
+class RoomSnapshotData
+{
+public:
+    QList<Player *> players;
+    QVector<PlayerState> playerStates;
+    QVector<QVariantMap> playerTags;
+
+    QString currentCardUsePattern;
+    QSgsEnum::CardUseReason currentCardUseReason;
+
+    QList<int> drawPile;
+    QList<int> discardPile;
+    QList<Card *> proceedingArea;
+    QVector<RoomObject::CardPlaceStruct> cardPlaces;
+
+    QSgsRandom random;
+};
+
 class RoomObjectPrivate
 {
 public:
-    QList<Card *> availableCards;
+    RoomObject *room;
+
+    // a card from the catalog is nullptr here until it is accessed, see realCard()
+    // the piles keep ids, so a card is only created when it comes into a player's area or is used
+    mutable QList<Card *> availableCards;
+    // indexed by (id - 1), 0 if the card is not from the catalog
+    QVector<int> catalogIds;
+
+    Card *realCard(int id) const;
     QList<Player *> players;
 
+    // the arena of virtual cards, indexed by (-id - 2)
+    // -1 is Card::S_UNKNOWN_CARD_ID, which released cards get, so no live card can have it
+    static inline int virtualCardId(int slot)
+    {
+        return -slot - 2;
+    }
+    static inline int virtualCardSlot(int id)
+    {
+        return -id - 2;
+    }
+
+    struct VirtualCardSlot
+    {
+        Card *card; // nullptr if the slot is free
+        RoomObject::VirtualCardLifetime lifetime;
+        int useDepth; // the card use depth when the card is created
+        int index; // the index of the card in virtualCards
+    };
+
+    QVector<VirtualCardSlot> virtualCardSlots;
+    QVector<int> freeVirtualCardSlots;
+    // released Card objects which are waiting to be reused
+    QVector<Card *> virtualCardPool;
+    // the live virtual cards
     QList<Card *> virtualCards;
+    int cardUseDepth;
+
+    int allocateVirtualCardSlot(Card *card, RoomObject::VirtualCardLifetime lifetime);
+    void releaseVirtualCardSlot(int slot);
 
     QString currentCardUsePattern;
     QSgsEnum::CardUseReason currentCardUseReason;
 
-    QList<Card *> drawPile;
-    QList<Card *> discardPile;
+    QList<int> drawPile;
+    QList<int> discardPile;
     QList<Card *> proceedingArea;
 
-    QHash<const Card *, RoomObject::CardPlaceStruct> cardPlaces;
+    // indexed by (id - 1), the same as availableCards
+    QVector<RoomObject::CardPlaceStruct> cardPlaces;
 
     RoomRequestHandler *handler;
+    QHash<const Player *, RoomDecider *> deciders;
+    QSgsRandom random;
+
+    // players.length() * players.length() matrices, indexed by the positions in players
+    // the ring only changes when a player dies, is removed or changes the seat
+    mutable QVector<int> rightDistances;
+    mutable QVector<int> aliveCounts; // the length of the ring, or 0 if the player is not on it
+    mutable bool ringValid;
+    // the corrections are computed on demand. A change of a player only resets its row and its column,
+    // at the next lookup, the whole matrix is reset when the ring or a shared state changes
+    mutable QVector<int> distanceCorrections;
+    mutable bool correctionsValid;
+    mutable QVector<bool> dirtyCorrections; // indexed by the positions in players
+    mutable bool anyCorrectionDirty;
+
+    void buildRing() const;
+    int cachedDistanceCorrection(int from, int to) const;
+
+    QList<const TriggerSkill *> triggerRules;
+    // indexed by TriggerEvent
+    mutable QVector<QList<const TriggerSkill *> > triggerTable;
+    mutable bool triggerTableValid;
+    // global trigger skills of all the packages, collected on the first build
+    mutable bool globalTriggerSkillsCollected;
+    mutable QList<const TriggerSkill *> globalTriggerSkills;
+
+    void buildTriggerTable() const;
+
+    // modifier skills of all the packages, collected on the first use
+    mutable bool modifierSkillsCollected;
+    mutable QList<const ProhibitSkill *> prohibitSkills;
+    mutable QList<const DistanceSkill *> distanceSkills;
+    mutable QList<const MaxCardsSkill *> maxCardsSkills;
+    mutable QList<const TargetModSkill *> targetModSkills;
+    mutable QList<const AttackRangeSkill *> attackRangeSkills;
+
+    void collectModifierSkills() const;
+    int distanceCorrection(const Player *from, const Player *to) const;
+
+    // the sums of extra() and the maximums of fixed() of the modifier skills for each player
+    struct PlayerModifiers
+    {
+        int maxCardsExtra;
+        int maxCardsFixed;
+        int attackRangeExtra[2]; // indexed by include_weapon
+        int attackRangeFixed[2];
+    };
+    mutable QHash<const Player *, PlayerModifiers> playerModifiers;
+
+    const PlayerModifiers &modifiers(const Player *player) const;
 };
 
+void RoomObjectPrivate::collectModifierSkills() const
+{
+    GameLogicCore *core = GameLogicCore::instance();
+    foreach (const QString &name, core->skillNames()) {
+        const Skill *skill = core->skill(name);
+        if (const ProhibitSkill *s = qobject_cast<const ProhibitSkill *>(skill))
+            prohibitSkills << s;
+        else if (const DistanceSkill *s = qobject_cast<const DistanceSkill *>(skill))
+            distanceSkills << s;
+        else if (const MaxCardsSkill *s = qobject_cast<const MaxCardsSkill *>(skill))
+            maxCardsSkills << s;
+        else if (const TargetModSkill *s = qobject_cast<const TargetModSkill *>(skill))
+            targetModSkills << s;
+        else if (const AttackRangeSkill *s = qobject_cast<const AttackRangeSkill *>(skill))
+            attackRangeSkills << s;
+    }
+
+    modifierSkillsCollected = true;
+}
+
+int RoomObjectPrivate::distanceCorrection(const Player *from, const Player *to) const
+{
+    if (!modifierSkillsCollected)
+        collectModifierSkills();
+
+    int correct = 0;
+    foreach (const DistanceSkill *skill, distanceSkills)
+        correct += skill->correct(from, to);
+
+    return correct;
+}
+
+const RoomObjectPrivate::PlayerModifiers &RoomObjectPrivate::modifiers(const Player *player) const
+{
+    QHash<const Player *, PlayerModifiers>::const_iterator it = playerModifiers.constFind(player);
+    if (it != playerModifiers.constEnd())
+        return it.value();
+
+    if (!modifierSkillsCollected)
+        collectModifierSkills();
+
+    PlayerModifiers m;
+    m.maxCardsExtra = m.maxCardsFixed = 0;
+    foreach (const MaxCardsSkill *skill, maxCardsSkills) {
+        m.maxCardsExtra += skill->extra(player);
+        m.maxCardsFixed = qMax(m.maxCardsFixed, skill->fixed(player));
+    }
+
+    for (int include_weapon = 0; include_weapon < 2; ++include_weapon) {
+        m.attackRangeExtra[include_weapon] = m.attackRangeFixed[include_weapon] = 0;
+        foreach (const AttackRangeSkill *skill, attackRangeSkills) {
+            m.attackRangeExtra[include_weapon] += skill->extra(player, include_weapon);
+            m.attackRangeFixed[include_weapon] = qMax(m.attackRangeFixed[include_weapon], skill->fixed(player, include_weapon));
+        }
+    }
+
+    return playerModifiers.insert(player, m).value();
+}
+
+void RoomObjectPrivate::buildRing() const
+{
+    int n = players.length();
+    rightDistances.fill(0, n * n);
+    aliveCounts.fill(0, n);
+
+    // positions in players, so that the matrix can be filled without looking the players up
+    QList<int> ring;
+    for (int i = 0; i < n; ++i) {
+        const Player *p = players.at(i);
+        if (p->isAlive() && !p->isRemoved())
+            ring << i;
+    }
+    std::stable_sort(ring.begin(), ring.end(), [this](int a, int b) {
+        return players.at(a)->seat() < players.at(b)->seat();
+    });
+
+    int alive = ring.length();
+    for (int i = 0; i < alive; ++i) {
+        int from = ring.at(i);
+        aliveCounts[from] = alive;
+        for (int j = 0; j < alive; ++j) {
+            if (i != j)
+                rightDistances[from * n + ring.at(j)] = (j - i + alive) % alive;
+        }
+    }
+
+    ringValid = true;
+}
+
+int RoomObjectPrivate::cachedDistanceCorrection(int from, int to) const
+{
+    int n = players.length();
+    if (!correctionsValid) {
+        distanceCorrections.fill(std::numeric_limits<int>::min(), n * n);
+        dirtyCorrections.fill(false, n);
+        anyCorrectionDirty = false;
+        correctionsValid = true;
+    } else if (anyCorrectionDirty) {
+        for (int i = 0; i < n; ++i) {
+            if (!dirtyCorrections.at(i))
+                continue;
+            for (int j = 0; j < n; ++j) {
+                distanceCorrections[i * n + j] = std::numeric_limits<int>::min();
+                distanceCorrections[j * n + i] = std::numeric_limits<int>::min();
+            }
+            dirtyCorrections[i] = false;
+        }
+        anyCorrectionDirty = false;
+    }
+
+    int &correct = distanceCorrections[from * n + to];
+    if (correct == std::numeric_limits<int>::min())
+        correct = (from == to) ? 0 : distanceCorrection(players.at(from), players.at(to));
+
+    return correct;
+}
+
+void RoomObjectPrivate::buildTriggerTable() const
+{
+    triggerTable.fill(QList<const TriggerSkill *>(), static_cast<int>(QSgsEnum::TriggerEvent::NumOfEvents));
+
+    if (!globalTriggerSkillsCollected) {
+        GameLogicCore *core = GameLogicCore::instance();
+        foreach (const QString &name, core->skillNames()) {
+            const TriggerSkill *skill = qobject_cast<const TriggerSkill *>(core->skill(name));
+            if (skill != nullptr && skill->isGlobal())
+                globalTriggerSkills << skill;
+        }
+        globalTriggerSkillsCollected = true;
+    }
+
+    QSet<const TriggerSkill *> present = triggerRules.toSet();
+    foreach (const TriggerSkill *skill, globalTriggerSkills)
+        present << skill;
+    foreach (const Player *p, players)
+        present.unite(p->triggerSkills());
+
+    foreach (const TriggerSkill *skill, present) {
+        foreach (QSgsEnum::TriggerEvent event, skill->triggerEvents())
+            triggerTable[static_cast<int>(event)] << skill;
+    }
+
+    for (int i = 0; i < triggerTable.length(); ++i) {
+        QList<const TriggerSkill *> &skills = triggerTable[i];
+        // QSet has no order, sort by name first to keep the order of skills of the same priority stable between rebuilds
+        std::sort(skills.begin(), skills.end(), [](const TriggerSkill *a, const TriggerSkill *b) {
+            return a->objectName() < b->objectName();
+        });
+        std::stable_sort(skills.begin(), skills.end(), [](const TriggerSkill *a, const TriggerSkill *b) {
+            return a->priority() > b->priority();
+        });
+    }
+
+    triggerTableValid = true;
+}
+
+Card *RoomObjectPrivate::realCard(int id) const
+{
+    Card *card = availableCards.value(id - 1, nullptr);
+    if (card == nullptr && id > 0 && id <= availableCards.length()) {
+        const CardCatalog &catalog = GameLogicCore::instance()->cardCatalog();
+        int catalogId = catalogIds.at(id - 1);
+        card = new Card(room, catalog.face(catalogId), id, catalog.suit(catalogId), catalog.number(catalogId), catalog.canRecast(catalogId), catalog.isTransferable(catalogId));
+        availableCards[id - 1] = card;
+    }
+
+    return card;
+}
+
+int RoomObjectPrivate::allocateVirtualCardSlot(Card *card, RoomObject::VirtualCardLifetime lifetime)
+{
+    int slot;
+    if (freeVirtualCardSlots.isEmpty()) {
+        slot = virtualCardSlots.length();
+        virtualCardSlots.append(VirtualCardSlot());
+    } else {
+        slot = freeVirtualCardSlots.takeLast();
+    }
+
+    VirtualCardSlot &s = virtualCardSlots[slot];
+    s.card = card;
+    s.lifetime = lifetime;
+    s.useDepth = cardUseDepth;
+    s.index = virtualCards.length();
+    virtualCards << card;
+
+    card->setId(virtualCardId(slot));
+    return slot;
+}
+
+void RoomObjectPrivate::releaseVirtualCardSlot(int slot)
+{
+    VirtualCardSlot &s = virtualCardSlots[slot];
+    Card *card = s.card;
+
+    // move the last live card into the hole so that releasing is O(1)
+    Card *last = virtualCards.takeLast();
+    if (last != card) {
+        virtualCards[s.index] = last;
+        virtualCardSlots[virtualCardSlot(last->id())].index = s.index;
+    }
+
+    s.card = nullptr;
+    freeVirtualCardSlots << slot;
+
+    card->setId(Card::S_UNKNOWN_CARD_ID);
+    virtualCardPool << card;
+}
+
 RoomObject::RoomObject(QObject *parent)
     : QObject(parent), d_ptr(new RoomObjectPrivate)
 {
     Q_D(RoomObject);
+    GameLogicCore::instance()->freeze();
+    d->room = this;
     d->currentCardUseReason = QSgsEnum::CardUseReason::Unknown;
     d->handler = nullptr;
+    d->ringValid = false;
+    d->correctionsValid = false;
+    d->anyCorrectionDirty = false;
+    d->triggerTableValid = false;
+    d->globalTriggerSkillsCollected = false;
+    d->modifierSkillsCollected = false;
+    d->cardUseDepth = 0;
 }
 
 RoomObject::~RoomObject()
@@ -97,6 +430,10 @@ void RoomObject::addRealCard(Card *card)
 {
     Q_D(RoomObject);
     d->availableCards << card;
+    while (d->cardPlaces.length() < d->availableCards.length()) {
+        d->cardPlaces << CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown, Atom(), -1};
+        d->catalogIds << 0;
+    }
     // @todo_Fs: notify
 }
 
@@ -104,29 +441,146 @@ void RoomObject::addRealCards(QList<Card *> cards)
 {
     Q_D(RoomObject);
     d->availableCards << cards;
+    while (d->cardPlaces.length() < d->availableCards.length()) {
+        d->cardPlaces << CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown, Atom(), -1};
+        d->catalogIds << 0;
+    }
+    // @todo_Fs: notify
+}
+
+void RoomObject::addCatalogCards(const QList<int> &catalogIds)
+{
+    Q_D(RoomObject);
+    const CardCatalog &catalog = GameLogicCore::instance()->cardCatalog();
+    d->availableCards.reserve(d->availableCards.length() + catalogIds.length());
+    d->cardPlaces.reserve(d->cardPlaces.length() + catalogIds.length());
+    d->catalogIds.reserve(d->catalogIds.length() + catalogIds.length());
+
+    foreach (int catalogId, catalogIds) {
+        if (!catalog.isValid(catalogId))
+            continue;
+
+        d->availableCards << nullptr;
+        d->cardPlaces << CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown, Atom(), -1};
+        d->catalogIds << catalogId;
+    }
+    // @todo_Fs: notify
+}
+
+int RoomObject::catalogId(int id) const
+{
+    Q_D(const RoomObject);
+    return d->catalogIds.value(id - 1, 0);
+}
+
+const CardFace *RoomObject::cardFace(int id) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->availableCards.length() && d->availableCards.at(id - 1) == nullptr)
+        return GameLogicCore::instance()->cardCatalog().face(d->catalogIds.at(id - 1));
+
+    const Card *c = card(id);
+    return c == nullptr ? nullptr : c->cardFace();
+}
+
+QSgsEnum::CardSuit RoomObject::cardSuit(int id) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->availableCards.length() && d->availableCards.at(id - 1) == nullptr)
+        return GameLogicCore::instance()->cardCatalog().suit(d->catalogIds.at(id - 1));
+
+    const Card *c = card(id);
+    return c == nullptr ? QSgsEnum::CardSuit::NoSuit : c->suit();
+}
+
+int RoomObject::cardNumber(int id) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->availableCards.length() && d->availableCards.at(id - 1) == nullptr)
+        return GameLogicCore::instance()->cardCatalog().number(d->catalogIds.at(id - 1));
+
+    const Card *c = card(id);
+    return c == nullptr ? 0 : c->number();
+}
+
+Card *RoomObject::newVirtualCard(const CardFace *cardFace, QSgsEnum::CardSuit suit, int number, VirtualCardLifetime lifetime)
+{
+    Q_D(RoomObject);
+    Card *card = nullptr;
+    if (d->virtualCardPool.isEmpty()) {
+        card = new Card(this, cardFace, Card::S_UNKNOWN_CARD_ID, suit, number);
+    } else {
+        card = d->virtualCardPool.takeLast();
+        card->reset(cardFace, suit, number);
+    }
+
+    d->allocateVirtualCardSlot(card, lifetime);
     // @todo_Fs: notify
+    return card;
 }
 
 void RoomObject::addVirtualCard(Card *card)
 {
     Q_D(RoomObject);
-    d->virtualCards << card;
+    // already in the arena
+    if (card == nullptr || (card->id() < 0 && this->card(card->id()) == card))
+        return;
+
+    card->setParent(this);
+    d->allocateVirtualCardSlot(card, VirtualCardLifetime::Room);
     // @todo_Fs: notify
 }
 
-const QList<Card *> &RoomObject::cards()
+void RoomObject::setVirtualCardLifetime(Card *card, VirtualCardLifetime lifetime)
+{
+    Q_D(RoomObject);
+    int slot = RoomObjectPrivate::virtualCardSlot(card->id());
+    if (slot >= 0 && slot < d->virtualCardSlots.length() && d->virtualCardSlots.at(slot).card == card)
+        d->virtualCardSlots[slot].lifetime = lifetime;
+}
+
+void RoomObject::releaseVirtualCard(Card *card)
+{
+    Q_D(RoomObject);
+    int slot = RoomObjectPrivate::virtualCardSlot(card->id());
+    if (slot >= 0 && slot < d->virtualCardSlots.length() && d->virtualCardSlots.at(slot).card == card)
+        d->releaseVirtualCardSlot(slot);
+}
+
+void RoomObject::beginCardUse()
 {
     Q_D(RoomObject);
-    return d->availableCards;
+    ++d->cardUseDepth;
 }
 
-QList<const Card *> RoomObject::cards() const
+void RoomObject::endCardUse()
+{
+    Q_D(RoomObject);
+    Q_ASSERT(d->cardUseDepth > 0);
+
+    for (int i = 0; i < d->virtualCardSlots.length(); ++i) {
+        const RoomObjectPrivate::VirtualCardSlot &s = d->virtualCardSlots.at(i);
+        if (s.card != nullptr && s.lifetime == VirtualCardLifetime::CardUse && s.useDepth >= d->cardUseDepth)
+            d->releaseVirtualCardSlot(i);
+    }
+
+    --d->cardUseDepth;
+}
+
+void RoomObject::releaseTurnVirtualCards()
+{
+    Q_D(RoomObject);
+    for (int i = 0; i < d->virtualCardSlots.length(); ++i) {
+        const RoomObjectPrivate::VirtualCardSlot &s = d->virtualCardSlots.at(i);
+        if (s.card != nullptr && s.lifetime != VirtualCardLifetime::Room)
+            d->releaseVirtualCardSlot(i);
+    }
+}
+
+int RoomObject::cardCount() const
 {
     Q_D(const RoomObject);
-    QList<const Card *> c;
-    foreach (Card *card, d->availableCards)
-        c << card;
-    return c;
+    return d->availableCards.length();
 }
 
 const QList<Card *> &RoomObject::virtualCards()
@@ -135,31 +589,45 @@ const QList<Card *> &RoomObject::virtualCards()
     return d->virtualCards;
 }
 
-QList<const Card *> RoomObject::virtualCards() const
+ConstListView<Card> RoomObject::virtualCards() const
 {
     Q_D(const RoomObject);
-    QList<const Card *> c;
-    foreach (Card *card, d->virtualCards)
-        c << card;
-    return c;
+    return ConstListView<Card>(d->virtualCards);
 }
 
 Card *RoomObject::card(int id)
 {
     Q_D(RoomObject);
     if (id > 0)
-        return d->availableCards.value(id - 1, nullptr);
-    else
-        return d->virtualCards.value(-id - 1, nullptr);
+        return d->realCard(id);
+    else if (id < Card::S_UNKNOWN_CARD_ID && RoomObjectPrivate::virtualCardSlot(id) < d->virtualCardSlots.length())
+        return d->virtualCardSlots.at(RoomObjectPrivate::virtualCardSlot(id)).card;
+
+    return nullptr;
 }
 
 const Card *RoomObject::card(int id) const
 {
     Q_D(const RoomObject);
     if (id > 0)
-        return d->availableCards.value(id - 1, nullptr);
-    else
-        return d->virtualCards.value(-id - 1, nullptr);
+        return d->realCard(id);
+    else if (id < Card::S_UNKNOWN_CARD_ID && RoomObjectPrivate::virtualCardSlot(id) < d->virtualCardSlots.length())
+        return d->virtualCardSlots.at(RoomObjectPrivate::virtualCardSlot(id)).card;
+
+    return nullptr;
+}
+
+Player *RoomObject::addPlayer()
+{
+    Q_D(RoomObject);
+    Player *player = new Player(this);
+    player->setSeat(d->players.length() + 1);
+    player->setAlive(true);
+    d->players << player;
+
+    invalidateDistances();
+    invalidateTriggerSkills();
+    return player;
 }
 
 const QList<Player *> &RoomObject::players()
@@ -168,13 +636,10 @@ const QList<Player *> &RoomObject::players()
     return d->players;
 }
 
-QList<const Player *> RoomObject::players() const
+ConstListView<Player> RoomObject::players() const
 {
     Q_D(const RoomObject);
-    QList<const Player *> p;
-    foreach (Player *player, d->players)
-        p << player;
-    return p;
+    return ConstListView<Player>(d->players);
 }
 
 Player *RoomObject::player(const QString &name)
@@ -211,40 +676,284 @@ QSgsEnum::CardUseReason RoomObject::currentCardUseReason() const
 
 
 
-QList<Card *> &RoomObject::drawPile()
+QList<int> &RoomObject::drawPile()
 {
     Q_D(RoomObject);
     return d->drawPile;
 }
 
-QList<const Card *> RoomObject::drawPile() const
+const QList<int> &RoomObject::drawPile() const
 {
     Q_D(const RoomObject);
-    QList<const Card *> c;
-    foreach (Card *card, d->drawPile)
-        c << card;
-    return c;
+    return d->drawPile;
 }
 
-QList<const Card *> RoomObject::discardPile() const
+const QList<int> &RoomObject::discardPile() const
 {
     Q_D(const RoomObject);
-    QList<const Card *> c;
-    foreach (Card *card, d->discardPile)
-        c << card;
-    return c;
+    return d->discardPile;
 }
 
-const QList<Card *> &RoomObject::discardPile()
+RoomObject::CardPlaceStruct RoomObject::cardPlace(const Card *card) const
+{
+    if (card == nullptr || card->isVirtualCard())
+        return cardPlace(0);
+
+    return cardPlace(card->id());
+}
+
+RoomObject::CardPlaceStruct RoomObject::cardPlace(int id) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->cardPlaces.length())
+        return d->cardPlaces.at(id - 1);
+
+    return CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown, Atom(), -1};
+}
+
+Player *RoomObject::cardOwner(int id) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->cardPlaces.length())
+        return d->cardPlaces.at(id - 1).player;
+
+    return nullptr;
+}
+
+bool RoomObject::isCardInHand(int id, const Player *player) const
+{
+    Q_D(const RoomObject);
+    if (id > 0 && id <= d->cardPlaces.length()) {
+        const CardPlaceStruct &place = d->cardPlaces.at(id - 1);
+        return place.place == QSgsEnum::CardPlace::Hand && place.player == player;
+    }
+
+    return false;
+}
+
+void RoomObject::setCardPlace(const Card *card, Player *player, QSgsEnum::CardPlace place, Atom pile, int position)
+{
+    if (card == nullptr || card->isVirtualCard())
+        return;
+
+    setCardPlace(card->id(), player, place, pile, position);
+}
+
+void RoomObject::setCardPlace(int id, Player *player, QSgsEnum::CardPlace place, Atom pile, int position)
 {
     Q_D(RoomObject);
-    return d->discardPile;
+    if (id <= 0 || id > d->cardPlaces.length())
+        return;
+
+    CardPlaceStruct &p = d->cardPlaces[id - 1];
+    // modifier skills may count the cards in the piles of a player
+    Player *oldPileOwner = p.pile.isNull() ? nullptr : p.player;
+    p.player = player;
+    p.place = place;
+    p.pile = pile;
+    p.position = position;
+
+    if (oldPileOwner != nullptr)
+        invalidateModifiers(oldPileOwner);
+    if (player != nullptr && !pile.isNull() && player != oldPileOwner)
+        invalidateModifiers(player);
 }
 
-RoomObject::CardPlaceStruct RoomObject::cardPlace(const Card *card) const
+void RoomObject::moveCard(Card *card, Player *to, QSgsEnum::CardPlace place)
+{
+    if (card == nullptr || card->isVirtualCard())
+        return;
+
+    moveCard(card->id(), to, place);
+}
+
+void RoomObject::moveCard(int id, Player *to, QSgsEnum::CardPlace place)
+{
+    Q_D(RoomObject);
+    if (id <= 0 || id > d->cardPlaces.length())
+        return;
+
+    const CardPlaceStruct from = d->cardPlaces.at(id - 1);
+    switch (from.place) {
+        case QSgsEnum::CardPlace::Hand:
+        case QSgsEnum::CardPlace::Equip:
+        case QSgsEnum::CardPlace::Judge:
+            if (from.player != nullptr)
+                from.player->removeCard(d->realCard(id), from.place);
+            break;
+        case QSgsEnum::CardPlace::DrawPile:
+            d->drawPile.removeOne(id);
+            break;
+        case QSgsEnum::CardPlace::DiscardPile:
+            d->discardPile.removeOne(id);
+            break;
+        case QSgsEnum::CardPlace::ProceedingArea:
+            d->proceedingArea.removeOne(d->realCard(id));
+            break;
+        default:
+            break;
+    }
+
+    switch (place) {
+        case QSgsEnum::CardPlace::Hand:
+        case QSgsEnum::CardPlace::Equip:
+        case QSgsEnum::CardPlace::Judge:
+            if (to != nullptr)
+                to->addCard(d->realCard(id), place);
+            break;
+        case QSgsEnum::CardPlace::DrawPile:
+            d->drawPile.prepend(id);
+            break;
+        case QSgsEnum::CardPlace::DrawPileBottom:
+            d->drawPile << id;
+            place = QSgsEnum::CardPlace::DrawPile;
+            break;
+        case QSgsEnum::CardPlace::DiscardPile:
+            d->discardPile.prepend(id);
+            break;
+        case QSgsEnum::CardPlace::ProceedingArea:
+            d->proceedingArea << d->realCard(id);
+            break;
+        default:
+            break;
+    }
+
+    setCardPlace(id, to, place);
+}
+
+QList<int> RoomObject::drawCardIds(Player *player, int n)
+{
+    Q_D(RoomObject);
+    QList<int> ids;
+    for (int i = 0; i < n; ++i) {
+        if (d->drawPile.isEmpty())
+            swapPile();
+        if (d->drawPile.isEmpty())
+            break;
+
+        int id = d->drawPile.first();
+        moveCard(id, player, QSgsEnum::CardPlace::Hand);
+        ids << id;
+    }
+
+    return ids;
+}
+
+QList<Card *> RoomObject::drawCards(Player *player, int n)
+{
+    Q_D(RoomObject);
+    QList<Card *> cards;
+    foreach (int id, drawCardIds(player, n))
+        cards << d->realCard(id);
+
+    return cards;
+}
+
+void RoomObject::setDecider(Player *player, RoomDecider *decider)
+{
+    Q_D(RoomObject);
+    if (decider == nullptr)
+        d->deciders.remove(player);
+    else
+        d->deciders[player] = decider;
+}
+
+RoomDecider *RoomObject::decider(const Player *player) const
+{
+    Q_D(const RoomObject);
+    return d->deciders.value(player, nullptr);
+}
+
+RoomSnapshot RoomObject::snapshot() const
 {
     Q_D(const RoomObject);
-    return d->cardPlaces.value(card, CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown});
+    RoomSnapshotData *data = new RoomSnapshotData;
+    data->players = d->players;
+    data->playerStates.reserve(d->players.length());
+    data->playerTags.reserve(d->players.length());
+    foreach (const Player *player, d->players) {
+        data->playerStates << player->saveState();
+        data->playerTags << player->tag;
+    }
+
+    data->currentCardUsePattern = d->currentCardUsePattern;
+    data->currentCardUseReason = d->currentCardUseReason;
+    data->drawPile = d->drawPile;
+    data->discardPile = d->discardPile;
+    data->proceedingArea = d->proceedingArea;
+    data->cardPlaces = d->cardPlaces;
+    data->random = d->random;
+
+    RoomSnapshot snapshot;
+    snapshot.d = QSharedPointer<const RoomSnapshotData>(data);
+    return snapshot;
+}
+
+bool RoomObject::restore(const RoomSnapshot &snapshot)
+{
+    Q_D(RoomObject);
+    if (snapshot.isNull())
+        return false;
+
+    const RoomSnapshotData *data = snapshot.d.data();
+    // players are only ever added, the ones added after the snapshot would be dropped silently
+    if (d->players.length() != data->players.length()) {
+        qDebug() << QStringLiteral("A room snapshot of %1 players is restored with %2 players").arg(data->players.length()).arg(d->players.length());
+        return false;
+    }
+
+    d->players = data->players;
+    for (int i = 0; i < data->players.length(); ++i) {
+        Player *player = data->players.at(i);
+        player->restoreState(data->playerStates.at(i));
+        player->tag = data->playerTags.at(i);
+    }
+
+    d->currentCardUsePattern = data->currentCardUsePattern;
+    d->currentCardUseReason = data->currentCardUseReason;
+    d->drawPile = data->drawPile;
+    d->discardPile = data->discardPile;
+    d->proceedingArea = data->proceedingArea;
+    d->cardPlaces = data->cardPlaces;
+    // the cards added after the snapshot are not in any place yet
+    while (d->cardPlaces.length() < d->availableCards.length())
+        d->cardPlaces << CardPlaceStruct{nullptr, QSgsEnum::CardPlace::PlaceUnknown, Atom(), -1};
+    d->random = data->random;
+
+    invalidateDistances();
+    invalidateModifiers();
+    invalidateTriggerSkills();
+    return true;
+}
+
+QSgsRandom &RoomObject::random()
+{
+    Q_D(RoomObject);
+    return d->random;
+}
+
+quint64 RoomObject::randomSeed() const
+{
+    Q_D(const RoomObject);
+    return d->random.initialSeed();
+}
+
+void RoomObject::setRandomSeed(quint64 seed)
+{
+    Q_D(RoomObject);
+    d->random.seed(seed);
+}
+
+void RoomObject::swapPile()
+{
+    Q_D(RoomObject);
+    d->random.shuffle(d->discardPile);
+    foreach (int id, d->discardPile)
+        setCardPlace(id, nullptr, QSgsEnum::CardPlace::DrawPile);
+
+    d->drawPile << d->discardPile;
+    d->discardPile.clear();
+    // @todo_Fs: notify
 }
 
 RoomRequestHandler *RoomObject::requestHandler() const
@@ -266,11 +975,23 @@ bool RoomObject::activate(Player *player, CardUseStruct *&cardUse, SkillInvokeSt
 {
     cardUse = nullptr;
     skillInvoke = nullptr;
+
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->activate(this, player, cardUse, skillInvoke);
+
     return false;
 }
 
 CardUseStruct RoomObject::askForUseCard(Player *player, const QString &pattern, const QString &prompt, const QString &reason, bool addHistory, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr) {
+        CardUseStruct use = decider->useCard(this, player, pattern, reason);
+        use.addHistory = addHistory;
+        return use;
+    }
+
     return CardUseStruct();
 }
 
@@ -286,6 +1007,10 @@ CardUseStruct RoomObject::askForUseSlashTo(Player *from, Player *to, const QStri
 
 Card *RoomObject::askForResponseCard(Player *player, const QString &pattern, const QString &prompt, const QString &reason, bool toTable, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->responseCard(this, player, pattern, reason);
+
     return nullptr;
 }
 
@@ -306,16 +1031,28 @@ Card *RoomObject::askForDiscard(Player *player, const QString &pattern, const QS
 
 QList<Card *> RoomObject::askForDiscard(Player *player, int minNum, int maxNum, const QString &prompt, const QString &reason, bool forced, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->selectCards(this, player, minNum, maxNum, forced, reason);
+
     return QList<Card *>();
 }
 
 QList<Card *> RoomObject::askForSelectCard(Player *player, int minNum, int maxNum, const QString &prompt, QSgsEnum::CardHandlingMethod handlingMethod, const QString &expandPile, bool forced, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->selectCards(this, player, minNum, maxNum, forced, prompt);
+
     return QList<Card *>();
 }
 
 QString RoomObject::askForChoice(Player *player, const QStringList &choices, const QString &reason, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->choice(this, player, choices, reason);
+
     return QString();
 }
 
@@ -341,6 +1078,10 @@ void RoomObject::askForTriggerOrder(...)
 
 bool RoomObject::askForConfirm(Player *player, const QString &prompt, const QString &reason, const QJsonValue &data)
 {
+    RoomDecider *decider = this->decider(player);
+    if (decider != nullptr)
+        return decider->confirm(this, player, reason);
+
     return false;
 }
 
@@ -351,25 +1092,164 @@ QList<Card *> RoomObject::askForPindian(Player *from, Player *to, const QString
 
 const ProhibitSkill *RoomObject::isProhibited(const Player *from, const Player *to, const Card *card) const
 {
+    Q_D(const RoomObject);
+    if (!d->modifierSkillsCollected)
+        d->collectModifierSkills();
+
+    foreach (const ProhibitSkill *skill, d->prohibitSkills) {
+        if (skill->isProhibited(from, to, const_cast<Card *>(card)))
+            return skill;
+    }
+
     return nullptr;
 }
 
+void RoomObject::invalidateDistances()
+{
+    Q_D(RoomObject);
+    d->ringValid = false;
+    d->correctionsValid = false;
+}
+
+void RoomObject::invalidateModifiers(const Player *player)
+{
+    Q_D(RoomObject);
+    if (player == nullptr) {
+        d->correctionsValid = false;
+        d->playerModifiers.clear();
+        return;
+    }
+
+    d->playerModifiers.remove(player);
+    if (d->correctionsValid) {
+        int i = d->players.indexOf(const_cast<Player *>(player));
+        if (i != -1) {
+            d->dirtyCorrections[i] = true;
+            d->anyCorrectionDirty = true;
+        }
+    }
+}
+
+int RoomObject::rightDistance(const Player *from, const Player *to) const
+{
+    Q_D(const RoomObject);
+    if (!d->ringValid)
+        d->buildRing();
+
+    int n = d->players.length();
+    int i = d->players.indexOf(const_cast<Player *>(from));
+    int j = d->players.indexOf(const_cast<Player *>(to));
+    if (i == -1 || j == -1)
+        return 0;
+
+    return d->rightDistances.at(i * n + j);
+}
+
+int RoomObject::seatDistance(const Player *from, const Player *to) const
+{
+    Q_D(const RoomObject);
+    if (!d->ringValid)
+        d->buildRing();
+
+    int n = d->players.length();
+    int i = d->players.indexOf(const_cast<Player *>(from));
+    int j = d->players.indexOf(const_cast<Player *>(to));
+    if (i == -1 || j == -1 || i == j || d->aliveCounts.at(i) == 0 || d->aliveCounts.at(j) == 0)
+        return 0;
+
+    int right = d->rightDistances.at(i * n + j);
+    return qMin(right, d->aliveCounts.at(i) - right) + d->cachedDistanceCorrection(i, j);
+}
+
+void RoomObject::addTriggerRule(const TriggerSkill *rule)
+{
+    Q_D(RoomObject);
+    if (rule == nullptr || d->triggerRules.contains(rule))
+        return;
+
+    d->triggerRules << rule;
+    d->triggerTableValid = false;
+}
+
+void RoomObject::invalidateTriggerSkills()
+{
+    Q_D(RoomObject);
+    d->triggerTableValid = false;
+}
+
+QList<const TriggerSkill *> RoomObject::triggerSkills(QSgsEnum::TriggerEvent event) const
+{
+    Q_D(const RoomObject);
+    if (!d->triggerTableValid)
+        d->buildTriggerTable();
+
+    return d->triggerTable.value(static_cast<int>(event));
+}
+
+bool RoomObject::hasTriggerSkills(QSgsEnum::TriggerEvent event) const
+{
+    Q_D(const RoomObject);
+    if (!d->triggerTableValid)
+        d->buildTriggerTable();
+
+    return !d->triggerTable.value(static_cast<int>(event)).isEmpty();
+}
+
 int RoomObject::correctDistance(const Player *from, const Player *to) const
 {
-    return 0;
+    Q_D(const RoomObject);
+    int i = d->players.indexOf(const_cast<Player *>(from));
+    int j = d->players.indexOf(const_cast<Player *>(to));
+    if (i == -1 || j == -1)
+        return d->distanceCorrection(from, to);
+
+    return d->cachedDistanceCorrection(i, j);
 }
 
 int RoomObject::correctMaxCards(const Player *target, bool fixed) const
 {
-    return 0;
+    Q_D(const RoomObject);
+    const RoomObjectPrivate::PlayerModifiers &m = d->modifiers(target);
+    return fixed ? m.maxCardsFixed : m.maxCardsExtra;
 }
 
 int RoomObject::correctCardTarget(const QSgsEnum::ModType type, const Player *from, Card *card) const
 {
-    return 0;
+    // not cached, the result depends on the card which is often a temporary virtual card
+    Q_D(const RoomObject);
+    if (!d->modifierSkillsCollected)
+        d->collectModifierSkills();
+
+    int x = 0;
+    foreach (const TargetModSkill *skill, d->targetModSkills) {
+        switch (type) {
+            case QSgsEnum::ModType::Residue: {
+                int residue = skill->residueNum(from, card);
+                if (residue >= 998)
+                    return residue;
+                x += residue;
+                break;
+            }
+            case QSgsEnum::ModType::DistanceLimit: {
+                int distanceLimit = skill->distanceLimit(from, card);
+                if (distanceLimit >= 998)
+                    return distanceLimit;
+                x += distanceLimit;
+                break;
+            }
+            case QSgsEnum::ModType::ExtraTarget:
+                x += skill->extraTargetNum(from, card);
+                break;
+        }
+    }
+
+    return x;
 }
 
 int RoomObject::correctAttackRange(const Player *target, bool include_weapon, bool fixed) const
 {
-    return 0;
+    Q_D(const RoomObject);
+    const RoomObjectPrivate::PlayerModifiers &m = d->modifiers(target);
+    int index = include_weapon ? 1 : 0;
+    return fixed ? m.attackRangeFixed[index] : m.attackRangeExtra[index];
 }
@@ -4,10 +4,17 @@
 #include "libqsgsgamelogicglobal.h"
 #include "enumeration.h"
 #include "structs.h"
+#include "atom.h"
+#include "constlistview.h"
+
+#include <QSgsCore/QSgsRandom>
 
 class Player;
 class Card;
+class CardFace;
 class ProhibitSkill;
+class TriggerSkill;
+class RoomDecider;
 
 class LIBQSGSGAMELOGIC_EXPORT RoomRequestReceiver
 {
@@ -55,6 +62,21 @@ private:
 };
 
 class RoomObjectPrivate;
+class RoomSnapshotData;
+
+// A saved state of a room, see RoomObject::snapshot()
+class LIBQSGSGAMELOGIC_EXPORT RoomSnapshot
+{
+public:
+    inline bool isNull() const
+    {
+        return d.isNull();
+    }
+
+private:
+    friend class RoomObject;
+    QSharedPointer<const RoomSnapshotData> d;
+};
 
 class LIBQSGSGAMELOGIC_EXPORT RoomObject : public QObject
 {
@@ -64,38 +86,110 @@ public:
     explicit RoomObject(QObject *parent = nullptr);
     /*virtual*/ ~RoomObject(); // if this class is meant to be a virtual class, make sure this destructor is virtual
 
+    // when a virtual card is released by the room
+    enum class VirtualCardLifetime
+    {
+        CardUse, // when the card use (or response) during which it is created finishes
+        Turn, // at the end of the current turn
+        Room // when the room is destroyed, e.g. a converted delayed trick in the judging area
+    };
+
     struct CardPlaceStruct
     {
         Player *player;
         QSgsEnum::CardPlace place;
+        Atom pile; // the private pile of player when the card is out of game
+        int position; // the index of the card in its area when it was put there, -1 if unknown
     };
 
     void addRealCard(Card *card);
     void addRealCards(QList<Card *> cards);
+    // adds the real cards from the card catalog of GameLogicCore, they get their ids in the order of catalogIds
+    // their Card objects are only created when they are accessed, the functions below read the catalog directly
+    // before that, so prefer them when scanning many cards
+    void addCatalogCards(const QList<int> &catalogIds);
+    int catalogId(int id) const;
+    const CardFace *cardFace(int id) const;
+    QSgsEnum::CardSuit cardSuit(int id) const;
+    int cardNumber(int id) const;
+
+    // virtual cards are kept in an arena, the id of a virtual card is -(slot + 2), as -1 is Card::S_UNKNOWN_CARD_ID
+    // released slots and Card objects are reused, so DO NOT keep a virtual card or its id after it is released
+    Card *newVirtualCard(const CardFace *cardFace, QSgsEnum::CardSuit suit = QSgsEnum::CardSuit::Tbd, int number = -1, VirtualCardLifetime lifetime = VirtualCardLifetime::CardUse);
+    // takes the ownership of a card created elsewhere, it lives until the room is destroyed unless its lifetime is changed
     void addVirtualCard(Card *card);
+    void setVirtualCardLifetime(Card *card, VirtualCardLifetime lifetime);
+    void releaseVirtualCard(Card *card);
+    // the card use procedure calls these around each card use or response, they can be nested
+    // endCardUse() releases the CardUse cards created since the matching beginCardUse()
+    void beginCardUse();
+    void endCardUse();
+    // called at the end of each turn, releases the Turn and CardUse cards
+    void releaseTurnVirtualCards();
 
-    const QList<Card *> &cards();
-    QList<const Card *> cards() const;
+    // the real cards have the ids from 1 to cardCount(), use card(id) to get one of them
+    int cardCount() const;
+    // the virtual cards which are not released, in no particular order
     const QList<Card *> &virtualCards();
-    QList<const Card *> virtualCards() const;
+    ConstListView<Card> virtualCards() const;
     Card *card(int id);
     const Card *card(int id) const;
 
+    // creates a player in the next seat, the player is owned by this room
+    Player *addPlayer();
     const QList<Player *> &players();
-    QList<const Player *> players() const;
+    ConstListView<Player> players() const;
     Player *player(const QString &name);
     const Player *player(const QString &name) const;
 
     const QString &currentCardUsePattern() const;
     QSgsEnum::CardUseReason currentCardUseReason() const;
 
-    QList<Card *> &drawPile();
-    QList<const Card *> drawPile() const;
+    // the piles keep card ids, so the cards in them don't have to be created
+    QList<int> &drawPile();
+    const QList<int> &drawPile() const;
+    const QList<int> &discardPile() const;
 
-    const QList<Card *> &discardPile();
-    QList<const Card *> discardPile() const;
+    // the places of real cards are kept in an array indexed by card id, virtual cards are always in PlaceUnknown
+    CardPlaceStruct cardPlace(const Card *card) const;
+    CardPlaceStruct cardPlace(int id) const;
+    Player *cardOwner(int id) const;
+    bool isCardInHand(int id, const Player *player) const;
+    // the card moving procedure should call this after each card arrives at its new place
+    void setCardPlace(const Card *card, Player *player, QSgsEnum::CardPlace place, Atom pile = Atom(), int position = -1);
+    void setCardPlace(int id, Player *player, QSgsEnum::CardPlace place, Atom pile = Atom(), int position = -1);
+    // moves a real card between the areas of players, the piles and the proceeding area, without any trigger event
+    // the id version only creates the Card object when the card comes into the area of a player or the proceeding area
+    void moveCard(Card *card, Player *to, QSgsEnum::CardPlace place);
+    void moveCard(int id, Player *to, QSgsEnum::CardPlace place);
+    // takes cards from the top of the draw pile into the hand of the player, swaps the piles when the draw pile runs out
+    QList<int> drawCardIds(Player *player, int n);
+    QList<Card *> drawCards(Player *player, int n);
 
-    CardPlaceStruct cardPlace(const Card *card) const; // using the const functions of the QHash to get the place of a card
+    // The state of the room and its players: the seats, the piles, the places of the cards, the cards, marks, flags,
+    // private piles and history of the players, the tags of the players and the random generator.
+    // Everything is copied on write, so a snapshot costs a few reference counts per player, a player which is not
+    // changed after the snapshot keeps sharing its state with it, and restoring a snapshot is as cheap as taking one.
+    // This is meant for speculative card uses and the lookahead of AIs in this room, the Card objects themselves
+    // and the virtual cards are not part of the state.
+    // A snapshot can't be restored once a player is added after it, restore() refuses and returns false then
+    RoomSnapshot snapshot() const;
+    bool restore(const RoomSnapshot &snapshot);
+
+    // every random choice of the game logic in this room should be made with this generator instead of qrand()
+    // the seed is chosen by makeSeed() when the room is created, record it at game start to replay the game,
+    // and set the recorded seed before the game starts to replay it
+    QSgsRandom &random();
+    quint64 randomSeed() const;
+    void setRandomSeed(quint64 seed);
+    // shuffles the discard pile into the bottom of the draw pile
+    void swapPile();
+
+    // a decider answers the following interactive methods for a player directly, on the thread of this room,
+    // without any request or result document. The handler is only used for the players without a decider
+    // RoomObject does not take the ownership of the decider
+    void setDecider(Player *player, RoomDecider *decider);
+    RoomDecider *decider(const Player *player) const;
 
     // set the handler of the following interactive methods. Note that RoomObject takes the ownership of the handler, DO NOT DELETE IT AFTER YOU SET IT!!
     RoomRequestHandler *requestHandler() const;
@@ -157,6 +251,29 @@ public:
     QList<Card *> askForPindian(Player *from, Player *to, const QString &reason);
 
 
+    // distances between players are cached in a matrix indexed by the players
+    // call invalidateDistances() when anything which affects the distances changes,
+    // e.g. a player dies or is removed, a horse is equipped or removed, or a DistanceSkill is gained or lost
+    void invalidateDistances();
+    // The corrections below are cached as well, this invalidates them but keeps the ring of players.
+    // A modifier skill may only read the state of the players it is asked about: their generals, kingdom, skills,
+    // cards, piles, marks, flags, hp, phase, face-up and chained states and dynamic properties. Players invalidate
+    // their own corrections when any of these changes. Player::tag and the state of other players are not tracked,
+    // whoever changes what a skill reads there calls this without a player, which invalidates all of them.
+    void invalidateModifiers(const Player *player = nullptr);
+    // the number of steps to the right on the ring of alive players, removed players are not counted
+    int rightDistance(const Player *from, const Player *to) const;
+    // the shorter side of the ring plus correctDistance(), without any fixed distances
+    int seatDistance(const Player *from, const Player *to) const;
+
+    // trigger skills which are present in this room for each event, sorted by priority
+    // a skill is present if a player owns it or the equip it belongs to, if it is global, or if it is added as a rule (e.g. game rules and scenario rules)
+    // events without any present skill can be skipped entirely
+    void addTriggerRule(const TriggerSkill *rule);
+    void invalidateTriggerSkills();
+    QList<const TriggerSkill *> triggerSkills(QSgsEnum::TriggerEvent event) const;
+    bool hasTriggerSkills(QSgsEnum::TriggerEvent event) const;
+
     // functions to get the correction between players
     const ProhibitSkill *isProhibited(const Player *from, const Player *to, const Card *card) const;
     int correctDistance(const Player *from, const Player *to) const;
@@ -0,0 +1,429 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#include "simulation.h"
+#include "roomobject.h"
+#include "player.h"
+#include "card.h"
+#include "cardface.h"
+#include "cardcatalog.h"
+#include "logiccore.h"
+#include "general.h"
+
+#include <QElapsedTimer>
+
+namespace {
+
+// a turn never takes more actions than this, in case a decider keeps using cards which return to its hand
+const int PlayActionLimit = 100;
+
+void useCard(RoomObject *room, const CardUseStruct &use)
+{
+    room->beginCardUse();
+
+    Card *card = const_cast<Card *>(use.card);
+    QList<Card *> realCards;
+    if (card->isVirtualCard())
+        realCards = card->subcards();
+    else
+        realCards << card;
+
+    foreach (Card *c, realCards)
+        room->moveCard(c, nullptr, QSgsEnum::CardPlace::ProceedingArea);
+
+    const CardFace *face = card->cardFace();
+    if (face != nullptr) {
+        CardUseStruct u = use;
+        const CardFace *validated = face->validate(u);
+        if (validated != nullptr)
+            validated->onUse(room, u);
+    }
+
+    // the cards which are not moved elsewhere by the effect are thrown
+    foreach (Card *c, realCards) {
+        if (room->cardPlace(c).place == QSgsEnum::CardPlace::ProceedingArea)
+            room->moveCard(c, nullptr, QSgsEnum::CardPlace::DiscardPile);
+    }
+
+    room->endCardUse();
+}
+
+int maxCards(const RoomObject *room, const Player *player)
+{
+    int fixed = room->correctMaxCards(player, true);
+    if (fixed > 0)
+        return fixed;
+
+    return qMax(player->hp(), 0) + room->correctMaxCards(player);
+}
+
+// The phases are only set, no TriggerEvent is fired for them, see the note on GameSimulator.
+// Replace this with the trigger dispatch of the game rule once RoomObject has one.
+void playTurn(RoomObject *room, Player *player, SimulationResult &result)
+{
+    ++result.turns;
+
+    player->setPhase(QSgsEnum::PlayerPhase::Start);
+
+    player->setPhase(QSgsEnum::PlayerPhase::Draw);
+    room->drawCardIds(player, 2);
+
+    player->setPhase(QSgsEnum::PlayerPhase::Play);
+    for (int i = 0; i < PlayActionLimit && player->isAlive(); ++i) {
+        CardUseStruct *cardUse = nullptr;
+        SkillInvokeStruct *skillInvoke = nullptr;
+        bool acted = room->activate(player, cardUse, skillInvoke);
+        if (acted && cardUse != nullptr && cardUse->card != nullptr) {
+            useCard(room, *cardUse);
+            ++result.cardUses;
+        }
+
+        delete cardUse;
+        delete skillInvoke;
+        if (!acted)
+            break;
+    }
+
+    if (player->isAlive()) {
+        player->setPhase(QSgsEnum::PlayerPhase::Discard);
+        int excess = player->handcardNum() - maxCards(room, player);
+        if (excess > 0) {
+            QList<Card *> cards = room->askForDiscard(player, excess, excess, QString(), QStringLiteral("gamerule"), true);
+            // a decider which doesn't obey the rule loses its last cards
+            QList<Card *> handcards = player->handcards();
+            while (cards.length() < excess && !handcards.isEmpty()) {
+                Card *card = handcards.takeLast();
+                if (!cards.contains(card))
+                    cards << card;
+            }
+
+            foreach (Card *card, cards.mid(0, excess))
+                room->moveCard(card, nullptr, QSgsEnum::CardPlace::DiscardPile);
+        }
+    }
+
+    player->setPhase(QSgsEnum::PlayerPhase::Finish);
+    player->setPhase(QSgsEnum::PlayerPhase::NotActive);
+    room->releaseTurnVirtualCards();
+}
+
+// every player gets a head general and a deputy general of the same kingdom if there are enough generals
+void assignGenerals(RoomObject *room, SimulationResult &result)
+{
+    const GameLogicCore *core = GameLogicCore::instance();
+    // sorted, the order of the hash in the core is different in each process and would break the replays
+    QStringList names = core->generalNames();
+    names.sort();
+    room->random().shuffle(names);
+
+    foreach (Player *player, room->players()) {
+        QStringList pair;
+        if (names.length() >= 2) {
+            const General *head = core->general(names.takeFirst());
+            const General *deputy = nullptr;
+            for (int i = 0; i < names.length(); ++i) {
+                const General *g = core->general(names.at(i));
+                if (g->kingdom() == head->kingdom()) {
+                    deputy = g;
+                    names.removeAt(i);
+                    break;
+                }
+            }
+            if (deputy == nullptr)
+                deputy = core->general(names.takeFirst());
+
+            player->setGeneral(head);
+            player->setGeneral2(deputy);
+            int maxHp = (head->doubleMaxHpHead() + deputy->doubleMaxHpDeputy()) / 2;
+            if (maxHp > 0) {
+                player->setMaxHp(maxHp);
+                player->setHp(maxHp);
+            }
+            pair << head->name() << deputy->name();
+        }
+        result.generals << pair;
+    }
+}
+
+// the game is over when the alive players are all of one kingdom, or when only one player is alive
+bool isGameOver(const RoomObject *room, SimulationResult &result)
+{
+    QList<const Player *> alive;
+    foreach (const Player *p, room->players()) {
+        if (p->isAlive())
+            alive << p;
+    }
+
+    bool over = alive.length() <= 1;
+    if (!over && !alive.first()->kingdom().isEmpty()) {
+        over = true;
+        foreach (const Player *p, alive) {
+            if (p->kingdom() != alive.first()->kingdom()) {
+                over = false;
+                break;
+            }
+        }
+    }
+
+    if (over) {
+        foreach (const Player *p, alive)
+            result.winnerSeats << p->seat();
+    }
+
+    return over;
+}
+
+}
+
+RoomDecider::RoomDecider()
+{
+}
+
+RoomDecider::~RoomDecider()
+{
+}
+
+bool RoomDecider::activate(RoomObject *room, Player *player, CardUseStruct *&cardUse, SkillInvokeStruct *&)
+{
+    QList<Card *> cards = player->handcards();
+    room->random().shuffle(cards);
+
+    foreach (Card *card, cards) {
+        const CardFace *face = card->cardFace();
+        if (face == nullptr || !face->isAvailable(player))
+            continue;
+
+        QList<Player *> targets;
+        if (!chooseTargets(room, player, card, QSgsEnum::CardUseReason::Play, QString(), targets))
+            continue;
+
+        cardUse = new CardUseStruct;
+        cardUse->card = card;
+        cardUse->from = player;
+        cardUse->to = targets;
+        cardUse->isHandcard = true;
+        cardUse->reason = QSgsEnum::CardUseReason::Play;
+        return true;
+    }
+
+    return false;
+}
+
+CardUseStruct RoomDecider::useCard(RoomObject *room, Player *player, const QString &pattern, const QString &)
+{
+    QList<Card *> cards = player->handcards();
+    room->random().shuffle(cards);
+
+    CardUseStruct use;
+    foreach (Card *card, cards) {
+        if (!card->match(pattern))
+            continue;
+
+        QList<Player *> targets;
+        if (!chooseTargets(room, player, card, QSgsEnum::CardUseReason::Response, pattern, targets))
+            continue;
+
+        use.card = card;
+        use.from = player;
+        use.to = targets;
+        use.isHandcard = true;
+        use.reason = QSgsEnum::CardUseReason::ResponseUse;
+        break;
+    }
+
+    return use;
+}
+
+Card *RoomDecider::responseCard(RoomObject *room, Player *player, const QString &pattern, const QString &)
+{
+    QList<Card *> cards = player->handcards();
+    room->random().shuffle(cards);
+
+    foreach (Card *card, cards) {
+        if (card->match(pattern))
+            return card;
+    }
+
+    return nullptr;
+}
+
+QList<Card *> RoomDecider::selectCards(RoomObject *room, Player *player, int minNum, int maxNum, bool forced, const QString &)
+{
+    QList<Card *> cards = player->handcards();
+    if (cards.isEmpty() || maxNum <= 0 || (!forced && minNum <= 0))
+        return QList<Card *>();
+
+    room->random().shuffle(cards);
+    return cards.mid(0, qBound(0, minNum, maxNum));
+}
+
+QString RoomDecider::choice(RoomObject *room, Player *, const QStringList &choices, const QString &)
+{
+    if (choices.isEmpty())
+        return QString();
+
+    return room->random().pick(choices);
+}
+
+bool RoomDecider::confirm(RoomObject *room, Player *, const QString &)
+{
+    return room->random().bounded(2) == 1;
+}
+
+bool RoomDecider::chooseTargets(RoomObject *room, Player *player, const Card *card, QSgsEnum::CardUseReason reason, const QString &pattern, QList<Player *> &targets)
+{
+    const CardFace *face = card->cardFace();
+    if (face == nullptr)
+        return false;
+
+    QList<Player *> candidates;
+    foreach (Player *p, room->players()) {
+        if (p->isAlive() && room->isProhibited(player, p, card) == nullptr)
+            candidates << p;
+    }
+    room->random().shuffle(candidates);
+
+    QList<const Player *> selected;
+    foreach (Player *p, candidates) {
+        if (face->targetFilter(selected, p, player, reason, pattern)) {
+            selected << p;
+            targets << p;
+        }
+    }
+
+    return face->targetsFeasible(selected, player, reason, pattern);
+}
+
+SimulationResult::SimulationResult()
+    : seed(0), rounds(0), turns(0), cardUses(0), finished(false), elapsedNsecs(0)
+{
+}
+
+class GameSimulatorPrivate
+{
+public:
+    int playerCount;
+    int maxRounds;
+    std::function<RoomDecider *(int)> deciderFactory;
+};
+
+GameSimulator::GameSimulator()
+    : d_ptr(new GameSimulatorPrivate)
+{
+    Q_D(GameSimulator);
+    d->playerCount = 8;
+    d->maxRounds = 50;
+}
+
+GameSimulator::~GameSimulator()
+{
+    Q_D(GameSimulator);
+    delete d;
+}
+
+int GameSimulator::playerCount() const
+{
+    Q_D(const GameSimulator);
+    return d->playerCount;
+}
+
+void GameSimulator::setPlayerCount(int count)
+{
+    Q_D(GameSimulator);
+    d->playerCount = qMax(count, 2);
+}
+
+int GameSimulator::maxRounds() const
+{
+    Q_D(const GameSimulator);
+    return d->maxRounds;
+}
+
+void GameSimulator::setMaxRounds(int rounds)
+{
+    Q_D(GameSimulator);
+    d->maxRounds = qMax(rounds, 1);
+}
+
+void GameSimulator::setDeciderFactory(const std::function<RoomDecider *(int)> &factory)
+{
+    Q_D(GameSimulator);
+    d->deciderFactory = factory;
+}
+
+SimulationResult GameSimulator::run(quint64 seed) const
+{
+    Q_D(const GameSimulator);
+    QElapsedTimer timer;
+    timer.start();
+
+    SimulationResult result;
+    result.seed = seed;
+
+    RoomObject room;
+    room.setRandomSeed(seed);
+
+    QList<RoomDecider *> deciders;
+    for (int i = 0; i < d->playerCount; ++i) {
+        Player *player = room.addPlayer();
+        player->setMaxHp(4);
+        player->setHp(4);
+
+        RoomDecider *decider = d->deciderFactory ? d->deciderFactory(player->seat()) : new RoomDecider;
+        deciders << decider;
+        room.setDecider(player, decider);
+    }
+    assignGenerals(&room, result);
+
+    QList<int> catalogIds;
+    for (int i = 1; i <= GameLogicCore::instance()->cardCatalog().count(); ++i)
+        catalogIds << i;
+    room.addCatalogCards(catalogIds);
+
+    for (int id = 1; id <= catalogIds.length(); ++id)
+        room.moveCard(id, nullptr, QSgsEnum::CardPlace::DrawPileBottom);
+    room.random().shuffle(room.drawPile());
+
+    foreach (Player *player, room.players())
+        room.drawCardIds(player, 4);
+
+    while (!result.finished && result.rounds < d->maxRounds) {
+        ++result.rounds;
+        foreach (Player *player, room.players()) {
+            if (!player->isAlive())
+                continue;
+
+            playTurn(&room, player, result);
+            if (isGameOver(&room, result)) {
+                result.finished = true;
+                break;
+            }
+        }
+    }
+
+    foreach (const Player *player, room.players()) {
+        if (player->isAlive())
+            result.survivorSeats << player->seat();
+    }
+
+    qDeleteAll(deciders);
+    result.elapsedNsecs = timer.nsecsElapsed();
+    return result;
+}
@@ -0,0 +1,107 @@
+/********************************************************************
+    Copyright (c) 2013-2015 - Mogara
+
+    This file is part of QSanguosha-Hegemony.
+
+    This game is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 3.0
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    General Public License for more details.
+
+    See the LICENSE file for more details.
+
+    Mogara
+    *********************************************************************/
+
+#ifndef _SIMULATION_H
+#define _SIMULATION_H
+
+#include "libqsgsgamelogicglobal.h"
+#include "structs.h"
+
+#include <functional>
+
+class RoomObject;
+class Player;
+class Card;
+
+// Answers the interactive methods of RoomObject for a player in the same process and on the same thread,
+// see RoomObject::setDecider(). There is no request document, no socket and no waiting.
+// The default implementation plays randomly but legally, with the generator of the room,
+// so a game played by it can be replayed with the seed of the room. AIs override the methods they know better.
+class LIBQSGSGAMELOGIC_EXPORT RoomDecider
+{
+public:
+    RoomDecider();
+    virtual ~RoomDecider();
+
+    // returns false to end the play phase
+    virtual bool activate(RoomObject *room, Player *player, CardUseStruct *&cardUse, SkillInvokeStruct *&skillInvoke);
+    virtual CardUseStruct useCard(RoomObject *room, Player *player, const QString &pattern, const QString &reason);
+    virtual Card *responseCard(RoomObject *room, Player *player, const QString &pattern, const QString &reason);
+    virtual QList<Card *> selectCards(RoomObject *room, Player *player, int minNum, int maxNum, bool forced, const QString &reason);
+    virtual QString choice(RoomObject *room, Player *player, const QStringList &choices, const QString &reason);
+    virtual bool confirm(RoomObject *room, Player *player, const QString &reason);
+
+protected:
+    // chooses the targets of a card greedily in a random order, returns false if the card can't be used
+    bool chooseTargets(RoomObject *room, Player *player, const Card *card, QSgsEnum::CardUseReason reason, const QString &pattern, QList<Player *> &targets);
+
+private:
+    Q_DISABLE_COPY(RoomDecider)
+};
+
+struct LIBQSGSGAMELOGIC_EXPORT SimulationResult
+{
+    SimulationResult();
+
+    quint64 seed;
+    int rounds;
+    int turns;
+    int cardUses;
+    bool finished; // false if the game is stopped by the round limit
+    QList<int> winnerSeats;
+    // the seats of the players alive at the end, also if the game is not finished
+    QList<int> survivorSeats;
+    // the head and deputy general of each player, indexed by (seat - 1), empty if there are no generals
+    QList<QStringList> generals;
+    qint64 elapsedNsecs;
+};
+
+class GameSimulatorPrivate;
+
+// Runs complete games headlessly on RoomObject, every player is answered by a RoomDecider.
+// A game is fully determined by its seed, and run() is reentrant, so different threads may run games at the same time
+// as long as the decider factory is thread safe
+// NOTE: this is a rule-less card loop, not the game. RoomObject has no trigger dispatch yet, so the turns only set
+// the phases, draw, use cards by their faces and discard. No TriggerEvent is fired, so no trigger skill or game rule
+// takes effect, and the results only measure the card faces, the deciders and the speed of RoomObject
+class LIBQSGSGAMELOGIC_EXPORT GameSimulator final
+{
+public:
+    GameSimulator();
+    ~GameSimulator();
+
+    int playerCount() const;
+    void setPlayerCount(int count);
+    // the game is stopped when no one wins after this number of rounds
+    int maxRounds() const;
+    void setMaxRounds(int rounds);
+    // creates the decider of each player of each game, the simulator deletes them after the game
+    // by default every player gets a RoomDecider
+    void setDeciderFactory(const std::function<RoomDecider *(int seat)> &factory);
+
+    SimulationResult run(quint64 seed) const;
+
+private:
+    Q_DISABLE_COPY(GameSimulator)
+    Q_DECLARE_PRIVATE(GameSimulator)
+    GameSimulatorPrivate *d_ptr;
+};
+
+#endif
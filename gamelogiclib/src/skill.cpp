@@ -340,7 +340,12 @@ bool ProactiveSkill::viewFilter(const QList<Card *> &selected, Card *to_select,
 Card *ProactiveSkill::viewAs(const QList<Card *> &cards, const Player *player, QSgsEnum::CardUseReason reason, const QString &pattern) const
 {
     if (cardFeasible(cards, player, reason, pattern)) {
-        Card *card = new Card(nullptr, findChild<SkillCardFace *>(), 0);
+        RoomObject *room = player->roomObject();
+        Card *card = nullptr;
+        if (room != nullptr)
+            card = room->newVirtualCard(findChild<SkillCardFace *>());
+        else
+            card = new Card(nullptr, findChild<SkillCardFace *>(), 0);
         card->addSubcards(cards);
         return card;
     }
@@ -747,7 +752,8 @@ SlashNoDistanceLimitSkill::~SlashNoDistanceLimitSkill()
 int SlashNoDistanceLimitSkill::distanceLimit(const Player *, Card *card) const
 {
     Q_D(const SlashNoDistanceLimitSkill);
-    if (card->cardFace()->isKindOf("Slash") && card->skillName() == d->origSkillName)
+    static const int slashKind = CardFace::kindId("Slash");
+    if (card->cardFace()->isKindOfId(slashKind) && card->skillName() == d->origSkillName)
         return 1000;
 
     return 0;
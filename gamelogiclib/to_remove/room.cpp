@@ -865,8 +865,10 @@ bool Room::doNotify(ServerPlayer *player, QSanProtocol::CommandType command, con
 
 bool Room::doBroadcastNotify(const QList<ServerPlayer *> &players, QSanProtocol::CommandType command, const QVariant &arg)
 {
-    foreach (ServerPlayer *player, players)
-        doNotify(player, command, arg);
+    Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, command);
+    packet.setMessageBody(arg);
+    BroadcastPacket broadcastPacket(packet);
+    broadcast(broadcastPacket, players);
     return true;
 }
 
@@ -874,12 +876,8 @@ bool Room::doBroadcastNotify(QSanProtocol::CommandType command, const QVariant &
 {
     Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, command);
     packet.setMessageBody(arg);
-
-    foreach (ServerPlayer *player, m_players) {
-        if (player != except) {
-            player->unicast(&packet);
-        }
-    }
+    BroadcastPacket broadcastPacket(packet);
+    broadcast(broadcastPacket, except);
     return true;
 }
 
@@ -899,8 +897,11 @@ bool Room::doNotify(ServerPlayer *player, int command, const char *arg)
 
 bool Room::doBroadcastNotify(const QList<ServerPlayer *> &players, int command, const char *arg)
 {
-    foreach (ServerPlayer *player, players)
-        doNotify(player, command, arg);
+    JsonDocument doc = JsonDocument::fromJson(arg);
+    if (doc.isValid())
+        doBroadcastNotify(players, command, doc.toVariant());
+    else
+        output(QString("Fail to parse the Json Value %1").arg(arg));
     return true;
 }
 
@@ -919,9 +920,7 @@ bool Room::doNotify(ServerPlayer *player, int command, const QVariant &arg)
 
 bool Room::doBroadcastNotify(const QList<ServerPlayer *> &players, int command, const QVariant &arg)
 {
-    foreach (ServerPlayer *player, players)
-        doNotify(player, command, arg);
-    return true;
+    return doBroadcastNotify(players, (QSanProtocol::CommandType)command, arg);
 }
 
 bool Room::doBroadcastNotify(int command, const QVariant &arg)
@@ -931,9 +930,24 @@ bool Room::doBroadcastNotify(int command, const QVariant &arg)
 
 // end for Lua
 
-void Room::broadcast(const QSanProtocol::AbstractPacket *packet, ServerPlayer *except)
+void Room::broadcast(const QSanProtocol::Packet *packet, ServerPlayer *except)
 {
-    broadcast(packet->toJson(), except);
+    BroadcastPacket broadcastPacket(*packet);
+    broadcast(broadcastPacket, except);
+}
+
+void Room::broadcast(QSanProtocol::BroadcastPacket &packet, ServerPlayer *except)
+{
+    broadcast(packet, m_players, except);
+}
+
+void Room::broadcast(QSanProtocol::BroadcastPacket &packet, const QList<ServerPlayer *> &players, ServerPlayer *except)
+{
+    // the packet is encoded only once for each wire format, all players share the encoded message
+    foreach (ServerPlayer *player, players) {
+        if (player != except)
+            player->unicast(packet);
+    }
 }
 
 bool Room::getResult(ServerPlayer *player, time_t timeOut)
@@ -1345,7 +1359,7 @@ int Room::askForCardChosen(ServerPlayer *player, ServerPlayer *who, const QStrin
         foreach (int id, disabled_ids)
             handcards.removeOne(id);
         do {
-            card_id = handcards.at(qrand() % handcards.length());
+            card_id = handcards.at(m_random.bounded(handcards.length()));
         } while (method == Card::MethodDiscard && !player->canDiscard(who, card_id));
     } else {
         AI *ai = player->getAI();
@@ -1361,7 +1375,7 @@ int Room::askForCardChosen(ServerPlayer *player, ServerPlayer *who, const QStrin
                     }
                 }
                 Q_ASSERT(!cards.isEmpty());
-                card_id = cards.at(qrand() % cards.length())->getId();
+                card_id = cards.at(m_random.bounded(cards.length()))->getId();
             }
         } else {
             QList<int> handcards;
@@ -1369,7 +1383,7 @@ int Room::askForCardChosen(ServerPlayer *player, ServerPlayer *who, const QStrin
                 handcards = VariantList2IntList(tag["askforCardsChosen"].toList());
             } else {
                 handcards = who->handCards();
-                qShuffle(handcards);
+                m_random.shuffle(handcards);
             }
 
             //LogMessage log1;
@@ -1399,7 +1413,7 @@ int Room::askForCardChosen(ServerPlayer *player, ServerPlayer *who, const QStrin
                     cards.removeOne(Sanguosha->getCard(id));
 
                 do {
-                    card_id = cards.at(qrand() % cards.length())->getId();
+                    card_id = cards.at(m_random.bounded(cards.length()))->getId();
                 } while (method == Card::MethodDiscard && !player->canDiscard(who, card_id));
             } else {
                 card_id = clientReply.at(0).toInt();
@@ -1435,7 +1449,7 @@ QList<int> Room::askForCardsChosen(ServerPlayer *chooser, ServerPlayer *choosee,
     setPlayerFlag(choosee, "continuous_card_chosen");
 
     QList<int> handcard_ids = choosee->handCards();
-    qShuffle(handcard_ids);
+    m_random.shuffle(handcard_ids);
     tag["askforCardsChosen"] = IntList2VariantList(handcard_ids);
 
     if (chooser && chooser->isAlive() && choosee && choosee->isAlive() && !choosee->isAllNude()) {
@@ -2234,10 +2248,17 @@ bool Room::canPause(ServerPlayer *player) const
 
 void Room::tryPause()
 {
+    // this is where the room thread picks up the reconnections, the game state is consistent here
+    processPendingReconnections();
+
     if (!canPause(getOwner())) return;
     QMutexLocker locker(&m_mutex);
-    while (game_paused)
+    while (game_paused) {
         m_waitCond.wait(locker.mutex());
+        locker.unlock();
+        processPendingReconnections();
+        locker.relock();
+    }
 }
 
 int Room::getLack() const
@@ -2277,7 +2298,7 @@ void Room::swapPile()
     if (limit > 0 && times == limit)
         gameOver(".");
 
-    qShuffle(*m_discardPile);
+    m_random.shuffle(*m_discardPile);
     foreach (int card_id, *m_discardPile)
         setCardMapping(card_id, NULL, Player::DrawPile);
     *m_drawPile += *m_discardPile;
@@ -2576,7 +2597,7 @@ void Room::prepareForStart()
 {
     if (scenario) {
         if (scenario->isRandomSeat() && Config.RandomSeat && mode != "custom_scenario")
-            qShuffle(m_players);
+            m_random.shuffle(m_players);
         //The process of the followings is moved to Room::run.
         //QStringList generals, generals2, kingdoms;
         //scenario->assign(generals, generals2, kingdoms, this);
@@ -2609,7 +2630,7 @@ void Room::prepareForStart()
         //}
     } else {
         if (Config.RandomSeat)
-            qShuffle(m_players);
+            m_random.shuffle(m_players);
         assignRoles();
     }
 
@@ -2832,11 +2853,12 @@ void Room::addRobotCommand(ServerPlayer *player, const QVariant &)
     if (Config.ForbidAddingRobot || isFull()) return;
     if (player && !player->isOwner()) return;
 
-    static QStringList names;
-    if (names.isEmpty()) {
-        names = GetConfigFromLuaState(Sanguosha->getLuaState(), "robot_names").toStringList();
-        qShuffle(names);
+    // shuffled once per room with its own generator, so the names are the same when the game is replayed with its seed
+    if (m_robotNames.isEmpty()) {
+        m_robotNames = GetConfigFromLuaState(Sanguosha->getLuaState(), "robot_names").toStringList();
+        m_random.shuffle(m_robotNames);
     }
+    QStringList names = m_robotNames;
 
     int n = 0;
     foreach (ServerPlayer *player, m_players) {
@@ -3065,8 +3087,8 @@ void Room::chooseGenerals(QList<ServerPlayer *> &to_assign, bool has_assign, boo
 
 void Room::run()
 {
-    // initialize random seed for later use
-    qsrand(QTime(0, 0, 0).secsTo(QTime::currentTime()));
+    // record the seed so that the game can be replayed with setRandomSeed()
+    setTag("RandomSeed", QString::number(m_random.initialSeed()));
     Config.AIDelay = Config.OriginAIDelay;
 
     foreach (ServerPlayer *player, m_players) {
@@ -3145,7 +3167,7 @@ void Room::assignRoles()
     int n = m_players.count();
 
     QStringList roles = Sanguosha->getRoleList(mode);
-    qShuffle(roles);
+    m_random.shuffle(roles);
 
     for (int i = 0; i < n; i++) {
         ServerPlayer *player = m_players[i];
@@ -3871,18 +3893,72 @@ ServerPlayer *Room::getFront(ServerPlayer *a, ServerPlayer *b) const
         return b;
 }
 
-void Room::reconnect(ServerPlayer *player, ClientSocket *socket)
+void Room::reconnect(ServerPlayer *player, ClientSocket *socket, unsigned int lastSerial)
 {
-    player->setSocket(socket);
-    player->setState("online");
+    // Called by the server on the main thread. The replay buffer and the room state belong to the room thread,
+    // so the player is resumed or marshalled there, at the next tryPause().
+    PendingReconnection reconnection;
+    reconnection.player = player;
+    reconnection.socket = socket;
+    reconnection.lastSerial = lastSerial;
 
-    marshal(player);
+    QMutexLocker locker(&m_mutex);
+    m_pendingReconnections << reconnection;
+    m_waitCond.wakeAll();
+}
 
-    broadcastProperty(player, "state");
+void Room::processPendingReconnections()
+{
+    QList<PendingReconnection> reconnections;
+    {
+        QMutexLocker locker(&m_mutex);
+        reconnections.swap(m_pendingReconnections);
+    }
+
+    foreach (const PendingReconnection &reconnection, reconnections) {
+        ServerPlayer *player = reconnection.player;
+        ClientSocket *socket = reconnection.socket;
+        // the client went away again while waiting, the player just stays offline
+        if (socket == NULL)
+            continue;
+        // another connection of the same player got here first
+        if (player->getState() != "offline") {
+            socket->disconnectFromHost();
+            continue;
+        }
+
+        if (reconnection.lastSerial != 0) {
+            // the missed packets are replayed before the socket is attached, so nothing can overtake them
+            if (!player->resume(socket, reconnection.lastSerial)) {
+                // The client resuming its session still shows its old state, so the whole state can't be sent over it.
+                // It has to start over with a new connection, which gets the state by marshal().
+                Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, S_COMMAND_WARN);
+                packet.setMessageBody("SESSION_EXPIRED");
+                socket->send(packet.toByteArray(socket->protocolFeatures()));
+                socket->disconnectFromHost();
+                continue;
+            }
+        } else {
+            player->setSocket(socket);
+        }
+
+        player->setState("online");
+
+        if (reconnection.lastSerial == 0)
+            marshal(player);
+
+        broadcastProperty(player, "state");
+    }
 }
 
 void Room::marshal(ServerPlayer *player)
 {
+    // Only called on the room thread, see processPendingReconnections(), so no other notification gets into the snapshot.
+    // A client which supports it receives and applies the whole state at once.
+    bool snapshot = player->protocolFeatures() & S_FEATURE_ROOM_SNAPSHOT;
+    if (snapshot)
+        player->beginSnapshot();
+
     notifyProperty(player, player, "objectName");
     notifyProperty(player, player, "role");
     notifyProperty(player, player, "flags", "marshalling");
@@ -3941,14 +4017,16 @@ void Room::marshal(ServerPlayer *player)
 
     doNotify(player, S_COMMAND_GAME_START, QVariant());
 
-    QList<int> drawPile = Sanguosha->getRandomCards();
-    doNotify(player, S_COMMAND_AVAILABLE_CARDS, JsonUtils::toJsonArray(drawPile));
-
+    // The list of available cards is left out, it is the largest part of the state and the client doesn't need it
+    // to show the game, the cards it sees are sent by the moves below.
     foreach (ServerPlayer *p, m_players)
         p->marshal(player);
 
     notifyProperty(player, player, "flags", "-marshalling");
     doNotify(player, S_COMMAND_UPDATE_PILE, m_drawPile->length());
+
+    if (snapshot)
+        player->endSnapshot();
 }
 
 void Room::startGame()
@@ -3985,7 +4063,7 @@ void Room::startGame()
     preparePlayers();
 
     QList<int> drawPile = *m_drawPile;
-    qShuffle(drawPile);
+    m_random.shuffle(drawPile);
     doBroadcastNotify(S_COMMAND_AVAILABLE_CARDS, JsonUtils::toJsonArray(drawPile));
 
     doBroadcastNotify(S_COMMAND_GAME_START, QVariant());
@@ -4773,7 +4851,7 @@ bool Room::notifyMoveCards(bool isLostPhase, QList<CardsMoveStruct> cards_moves,
         moveId = --_m_lastMovementId;
     Q_ASSERT(_m_lastMovementId >= 0);
     foreach (ServerPlayer *player, players) {
-        if (player->isOffline()) continue;
+        // offline players are notified as well, a resuming client gets the moves it missed
         JsonArray arg;
         arg << moveId;
         int move_num = cards_moves.size();
@@ -5083,6 +5161,16 @@ void Room::removeTag(const QString &key)
     tag.remove(key);
 }
 
+QSgsRandom &Room::random()
+{
+    return m_random;
+}
+
+void Room::setRandomSeed(quint64 seed)
+{
+    m_random.seed(seed);
+}
+
 void Room::setEmotion(ServerPlayer *target, const QString &emotion)
 {
     JsonArray arg;
@@ -5232,7 +5320,7 @@ void Room::askForLuckCard()
                 m_drawPile->prepend(card_id);
             }
         }
-        qShuffle(*m_drawPile);
+        m_random.shuffle(*m_drawPile);
         int index = -1;
         foreach (ServerPlayer *player, used) {
             index++;
@@ -5279,7 +5367,7 @@ Card::Suit Room::askForSuit(ServerPlayer *player, const QString &reason)
 
     bool success = doRequest(player, S_COMMAND_CHOOSE_SUIT, QVariant(), true);
 
-    Card::Suit suit = Card::AllSuits[qrand() % 4];
+    Card::Suit suit = Card::AllSuits[m_random.bounded(4)];
     if (success) {
         const QVariant &clientReply = player->getClientReply();
         QString suitStr = clientReply.toString();
@@ -6163,7 +6251,7 @@ ServerPlayer *Room::askForPlayerChosen(ServerPlayer *player, const QList<ServerP
     if (choice && !targets.contains(choice))
         choice = NULL;
     if (choice == NULL && !optional)
-        choice = targets.at(qrand() % targets.length());
+        choice = targets.at(m_random.bounded(targets.length()));
     if (choice) {
         if (notify_skill) {
             notifySkillInvoked(player, skillName);
@@ -6230,7 +6318,7 @@ QList<ServerPlayer *> Room::askForPlayersChosen(ServerPlayer *player, const QLis
         foreach (ServerPlayer *p, result)
             copy.removeOne(p);
         while (result.length() < min_num)
-            result << copy.takeAt(qrand() % copy.length());
+            result << copy.takeAt(m_random.bounded(copy.length()));
 
     }
     if (!result.isEmpty()) {
@@ -6270,12 +6358,12 @@ QString Room::askForGeneral(ServerPlayer *player, const QStringList &generals, c
     QString default_choice = _default_choice;
 
     if (default_choice.isEmpty()) {
-        default_choice = generals.at(qrand() % generals.length());
+        default_choice = generals.at(m_random.bounded(generals.length()));
 
         if (!single_result) {
             QStringList heros = generals;
             heros.removeOne(default_choice);
-            default_choice += "+" + heros.at(qrand() % heros.length());
+            default_choice += "+" + heros.at(m_random.bounded(heros.length()));
         }
     }
 
@@ -6738,8 +6826,8 @@ bool Room::askForYiji(ServerPlayer *guojia, QList<int> &cards, const QString &sk
             return false;
         else {
             ids.clear();
-            ids << cards.at(qrand() % cards.length());
-            target = players.at(qrand() % players.length());
+            ids << cards.at(m_random.bounded(cards.length()));
+            target = players.at(m_random.bounded(players.length()));
         }
     }
 
@@ -6792,7 +6880,7 @@ QString Room::askForOrder(ServerPlayer *player)
 
     bool success = doRequest(player, S_COMMAND_CHOOSE_ORDER, (int)S_REASON_CHOOSE_ORDER_TURN, true);
 
-    Game3v3Camp result = qrand() % 2 == 0 ? S_CAMP_WARM : S_CAMP_COOL;
+    Game3v3Camp result = m_random.bounded(2) == 0 ? S_CAMP_WARM : S_CAMP_COOL;
     const QVariant &clientReply = player->getClientReply();
     if (success && JsonUtils::isNumber(clientReply))
         result = (Game3v3Camp)clientReply.toInt();
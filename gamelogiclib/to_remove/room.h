@@ -32,6 +32,9 @@ struct lua_State;
 struct LogMessage;
 
 #include "serverplayer.h"
+#include "random.h"
+
+#include <QPointer>
 
 #include "libqsgsgamelogicglobal.h"
 
@@ -293,7 +296,8 @@ public:
     ServerPlayer *getOwner() const;
     void updateStateItem();
 
-    void reconnect(ServerPlayer *player, ClientSocket *socket);
+    // queues the reconnection for the room thread, which handles it at its next tryPause()
+    void reconnect(ServerPlayer *player, ClientSocket *socket, unsigned int lastSerial = 0);
     void marshal(ServerPlayer *player);
 
     void sortByActionOrder(QList<ServerPlayer *> &players);
@@ -304,6 +308,11 @@ public:
     QVariant getTag(const QString &key) const;
     void removeTag(const QString &key);
 
+    // every random choice in this room is made with this generator, its seed is recorded in the "RandomSeed" tag
+    // to replay a game, set the recorded seed before the game starts
+    QSgsRandom &random();
+    void setRandomSeed(quint64 seed);
+
     void setEmotion(ServerPlayer *target, const QString &emotion);
 
     Player::Place getCardPlace(int card_id) const;
@@ -416,7 +425,9 @@ public:
     void pause(ServerPlayer *player, const QVariant &);
     void resume(ServerPlayer *player, const QVariant &);
 
-    void broadcast(const QSanProtocol::AbstractPacket *packet, ServerPlayer *except = NULL);
+    void broadcast(const QSanProtocol::Packet *packet, ServerPlayer *except = NULL);
+    void broadcast(QSanProtocol::BroadcastPacket &packet, ServerPlayer *except = NULL);
+    void broadcast(QSanProtocol::BroadcastPacket &packet, const QList<ServerPlayer *> &players, ServerPlayer *except = NULL);
     void networkDelayTestCommand(ServerPlayer *player, const QVariant &);
     inline RoomState *getRoomState()
     {
@@ -557,10 +568,21 @@ private:
     bool game_paused;
     QWaitCondition m_waitCond;
     mutable QMutex m_mutex;
+
+    struct PendingReconnection
+    {
+        ServerPlayer *player;
+        QPointer<ClientSocket> socket; // the server deletes it if it disconnects before the room thread gets to it
+        unsigned int lastSerial;
+    };
+    QList<PendingReconnection> m_pendingReconnections; // guarded by m_mutex
+    void processPendingReconnections();
     lua_State *L;
     QList<AI *> ais;
 
     RoomThread *thread;
+    QSgsRandom m_random;
+    QStringList m_robotNames;
     QSemaphore _m_semRaceRequest; // When race starts, server waits on his semaphore for the first replier
     QSemaphore _m_semRoomMutex; // Provide per-room  (rather than per-player) level protection of any shared variables
 
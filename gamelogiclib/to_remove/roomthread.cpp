@@ -28,6 +28,8 @@
 #include "settings.h"
 #include "standard.h"
 #include "json.h"
+
+#include <algorithm>
 #include "structs.h"
 
 #include <QTime>
@@ -160,7 +162,6 @@ void RoomThread::_handleTurnBrokenNormal(GameRule *game_rule)
 
 void RoomThread::run()
 {
-    qsrand(QTime(0, 0, 0).secsTo(QTime::currentTime()));
     Sanguosha->registerRoom(room);
 
     addTriggerSkill(game_rule);
@@ -222,12 +223,8 @@ bool RoomThread::trigger(TriggerEvent triggerEvent, Room *room, ServerPlayer *ta
 
     try {
         QList<const TriggerSkill *> triggered;
+        // skill_table is kept sorted by addTriggerSkill()
         QList<const TriggerSkill *> &skills = skill_table[triggerEvent];
-        //         foreach (const TriggerSkill *skill,skills){
-        //             skill->setCurrentPriority(skill->getDynamicPriority(triggerEvent));
-        //         }
-
-        qStableSort(skills.begin(), skills.end(), [triggerEvent](const TriggerSkill *a, const TriggerSkill *b) {return a->getDynamicPriority(triggerEvent) > b->getDynamicPriority(triggerEvent); });
 
         do {
             trigger_who.clear();
@@ -253,22 +250,10 @@ bool RoomThread::trigger(TriggerEvent triggerEvent, Room *room, ServerPlayer *ta
                             foreach (ServerPlayer *p, room->getPlayers()) {
                                 if (triggerSkillList.contains(p) && !triggerSkillList.value(p).isEmpty()) {
                                     foreach (const QString &skill_name, triggerSkillList.value(p)) {
-                                        const TriggerSkill *trskill = Sanguosha->getTriggerSkill(skill_name);
-                                        if (trskill) { // "yiji"
+                                        const TriggerSkill *trskill = getTriggerSkill(skill_name);
+                                        if (trskill) {
                                             will_trigger.append(trskill);
                                             trigger_who[p].append(skill_name);
-                                        } else {
-                                            trskill = Sanguosha->getTriggerSkill(skill_name.split("'").last());
-                                            if (trskill) { // "sgs1'songwei"
-                                                will_trigger.append(trskill);
-                                                trigger_who[p].append(skill_name);
-                                            } else {
-                                                trskill = Sanguosha->getTriggerSkill(skill_name.split("->").first());
-                                                if (trskill) { // "tieqi->sgs4+sgs8+sgs1+sgs2"
-                                                    will_trigger.append(trskill);
-                                                    trigger_who[p].append(skill_name);
-                                                }
-                                            }
                                         }
                                     }
                                 }
@@ -293,11 +278,7 @@ bool RoomThread::trigger(TriggerEvent triggerEvent, Room *room, ServerPlayer *ta
                         if (who_skills.isEmpty()) break;
                         bool has_compulsory = false;
                         foreach (const QString &skill, who_skills) {
-                            const TriggerSkill *trskill = Sanguosha->getTriggerSkill(skill); // "yiji"
-                            if (!trskill)
-                                trskill = Sanguosha->getTriggerSkill(skill.split("'").last()); // "sgs1'songwei"
-                            if (!trskill)
-                                trskill = Sanguosha->getTriggerSkill(skill.split("->").first()); // "tieqi->sgs4+sgs8+sgs1+sgs2"
+                            const TriggerSkill *trskill = getTriggerSkill(skill);
                             if (trskill && p->hasShownSkill(trskill)
                                 && (trskill->getFrequency() == Skill::Compulsory
                                 //|| trskill->getFrequency() == Skill::NotCompulsory //for Paoxia, Anjian, etc.
@@ -447,20 +428,8 @@ bool RoomThread::trigger(TriggerEvent triggerEvent, Room *room, ServerPlayer *ta
                                     foreach (ServerPlayer *player, room->getAllPlayers(true)) {
                                         if (triggerSkillList.contains(player) && !triggerSkillList.value(player).isEmpty()) {
                                             foreach (const QString &skill_name, triggerSkillList.value(player)) {
-                                                const TriggerSkill *trskill = Sanguosha->getTriggerSkill(skill_name);
-                                                if (trskill) // "yiji"
+                                                if (getTriggerSkill(skill_name))
                                                     trigger_who[player].append(skill_name);
-                                                else {
-                                                    trskill = Sanguosha->getTriggerSkill(skill_name.split("'").last());
-                                                    if (trskill) // "sgs1'songwei"
-                                                        trigger_who[player].append(skill_name);
-                                                    else {
-                                                        trskill = Sanguosha->getTriggerSkill(skill_name.split("->").first());
-                                                        if (trskill) { // "tieqi->sgs4+sgs8+sgs1+sgs2"
-                                                            trigger_who[player].append(skill_name);
-                                                        }
-                                                    }
-                                                }
                                             }
                                         }
                                     }
@@ -506,11 +475,7 @@ bool RoomThread::trigger(TriggerEvent triggerEvent, Room *room, ServerPlayer *ta
                         if (has_compulsory) {
                             has_compulsory = false;
                             foreach (const QString &skillName, trigger_who[p]) {
-                                const TriggerSkill *s = Sanguosha->getTriggerSkill(skillName); // "yiji"
-                                if (!s)
-                                    s = Sanguosha->getTriggerSkill(skillName.split("'").last()); // "sgs1'songwei"
-                                if (!s)
-                                    s = Sanguosha->getTriggerSkill(skillName.split("->").first()); // "tieqi->sgs4+sgs8+sgs1+sgs2"
+                                const TriggerSkill *s = getTriggerSkill(skillName);
                                 if (s && p->hasShownSkill(s)
                                     && (s->getFrequency() == Skill::Compulsory
                                     //|| s->getFrequency() == Skill::NotCompulsory // for Paoxiao, Anjian, etc.
@@ -594,9 +559,11 @@ void RoomThread::addTriggerSkill(const TriggerSkill *skill)
 
     QList<TriggerEvent> events = skill->getTriggerEvents();
     foreach (const TriggerEvent &triggerEvent, events) {
+        // insert after the skills of higher or equal priority, so the table never needs to be sorted again
         QList<const TriggerSkill *> &table = skill_table[triggerEvent];
-        table << skill;
-        qStableSort(table.begin(), table.end(), [triggerEvent](const TriggerSkill *a, const TriggerSkill *b) {return a->getDynamicPriority(triggerEvent) > b->getDynamicPriority(triggerEvent); });
+        int priority = skill->getDynamicPriority(triggerEvent);
+        QList<const TriggerSkill *>::iterator pos = std::upper_bound(table.begin(), table.end(), priority, [triggerEvent](int p, const TriggerSkill *s) {return p > s->getDynamicPriority(triggerEvent); });
+        table.insert(pos, skill);
     }
 
     if (skill->isVisible()) {
@@ -608,6 +575,22 @@ void RoomThread::addTriggerSkill(const TriggerSkill *skill)
     }
 }
 
+const TriggerSkill *RoomThread::getTriggerSkill(const QString &name)
+{
+    QHash<QString, const TriggerSkill *>::const_iterator it = trigger_skill_cache.constFind(name);
+    if (it != trigger_skill_cache.constEnd())
+        return it.value();
+
+    const TriggerSkill *skill = Sanguosha->getTriggerSkill(name); // "yiji"
+    if (!skill)
+        skill = Sanguosha->getTriggerSkill(name.split("'").last()); // "sgs1'songwei"
+    if (!skill)
+        skill = Sanguosha->getTriggerSkill(name.split("->").first()); // "tieqi->sgs4+sgs8+sgs1+sgs2"
+
+    trigger_skill_cache.insert(name, skill);
+    return skill;
+}
+
 void RoomThread::delay(long secs)
 {
     if (secs == -1) secs = Config.AIDelay;
@@ -65,12 +65,15 @@ protected:
 
 private:
     void _handleTurnBrokenNormal(GameRule *game_rule);
+    // resolves "yiji", "sgs1'songwei" and "tieqi->sgs4+sgs8+sgs1+sgs2" to the skill, the results are cached
+    const TriggerSkill *getTriggerSkill(const QString &name);
 
     Room *room;
     QString order;
 
     QList<const TriggerSkill *> skill_table[NumOfEvents];
     QSet<QString> skillSet;
+    QHash<QString, const TriggerSkill *> trigger_skill_cache;
 
     QList<EventTriplet> event_stack;
     GameRule *game_rule;
@@ -32,13 +32,15 @@
 using namespace QSanProtocol;
 
 const int ServerPlayer::S_NUM_SEMAPHORES = 6;
+const int ServerPlayer::S_REPLAY_BUFFER_SIZE = 512;
 
 ServerPlayer::ServerPlayer(Room *room)
     : Player(room), m_isClientResponseReady(false), m_isWaitingReply(false),
     event_received(false), socket(NULL), room(room),
     ai(NULL), trust_ai(new TrustAI(this)), recorder(NULL),
-    _m_phases_index(0)
+    _m_phases_index(0), _m_isTakingSnapshot(false), _m_isResumable(false)
 {
+    _m_replayBuffer.setCapacity(S_REPLAY_BUFFER_SIZE);
     semas = new QSemaphore *[S_NUM_SEMAPHORES];
     for (int i = 0; i < S_NUM_SEMAPHORES; i++)
         semas[i] = new QSemaphore(0);
@@ -103,7 +105,7 @@ int ServerPlayer::getRandomHandCardId() const
 
 const Card *ServerPlayer::getRandomHandCard() const
 {
-    int index = qrand() % handcards.length();
+    int index = room->random().bounded(handcards.length());
     return handcards.at(index);
 }
 
@@ -238,7 +240,7 @@ QList<int> ServerPlayer::forceToDiscard(int discard_num, bool include_equip, boo
         flags.append("e");
 
     QList<const Card *> all_cards = getCards(flags);
-    qShuffle(all_cards);
+    room->random().shuffle(all_cards);
 
     for (int i = 0; i < all_cards.length(); i++) {
         if (!is_discard || !isJilei(all_cards.at(i)))
@@ -262,7 +264,7 @@ QList<int> ServerPlayer::forceToDiscard(int discard_num, const QString &pattern,
         foreach (int id, getPile(pile))
             all_cards << Sanguosha->getCard(id);
     }
-    qShuffle(all_cards);
+    room->random().shuffle(all_cards);
 
     for (int i = 0; i < all_cards.length(); i++) {
         if (!is_discard || !isJilei(all_cards.at(i)))
@@ -331,6 +333,9 @@ int ServerPlayer::getPlayerNumWithSameKingdom(const QString &reason, const QStri
 void ServerPlayer::setSocket(ClientSocket *socket)
 {
     if (socket) {
+        // once the client is able to resume its session, the packets are kept for the disconnections to come
+        if (socket->protocolFeatures() & S_FEATURE_SESSION_RESUME)
+            _m_isResumable = true;
         connect(socket, &ClientSocket::disconnected, this, &ServerPlayer::disconnected);
         connect(socket, &ClientSocket::message_got, this, &ServerPlayer::getMessage);
         connect(this, &ServerPlayer::message_ready, this, &ServerPlayer::sendMessage);
@@ -359,7 +364,7 @@ void ServerPlayer::kick()
 
 void ServerPlayer::getMessage(QByteArray request)
 {
-    if (request.endsWith('\n'))
+    if (!Packet::isBinary(request) && request.endsWith('\n'))
         request.chop(1);
 
     emit request_got(request);
@@ -390,6 +395,33 @@ void ServerPlayer::unicast(const QByteArray &message)
         recorder->recordLine(message);
 }
 
+void ServerPlayer::unicast(BroadcastPacket &packet)
+{
+    if (_m_isTakingSnapshot && packet.packet().packetType() == S_TYPE_NOTIFICATION) {
+        _m_snapshot << QVariant(JsonArray() << packet.packet().commandType() << packet.packet().messageBody());
+        return;
+    }
+
+    // kept while the player is offline as well, that is what a resuming client missed
+    if (_m_isResumable)
+        _m_replayBuffer.append(packet.packet());
+
+    const QByteArray &message = packet.encoded(protocolFeatures());
+    if (socket != NULL && isCosmeticCommand(packet.packet().commandType())) {
+        // dropped rather than queued if the client doesn't keep up with reading
+        socket->sendDroppable(message);
+        if (recorder)
+            recorder->recordLine(message);
+    } else {
+        unicast(message);
+    }
+}
+
+int ServerPlayer::protocolFeatures() const
+{
+    return socket != NULL ? socket->protocolFeatures() : S_FEATURE_NONE;
+}
+
 void ServerPlayer::startNetworkDelayTest()
 {
     test_time = QDateTime::currentDateTime();
@@ -452,16 +484,71 @@ void ServerPlayer::sendMessage(const QByteArray &message)
     }
 }
 
-void ServerPlayer::unicast(const AbstractPacket *packet)
+void ServerPlayer::unicast(const Packet *packet)
 {
-    unicast(packet->toJson());
+    BroadcastPacket broadcastPacket(*packet);
+    unicast(broadcastPacket);
+}
+
+bool ServerPlayer::resume(ClientSocket *socket, unsigned int lastSerial)
+{
+    int features = socket->protocolFeatures();
+    if (!(features & S_FEATURE_SESSION_RESUME) || lastSerial == 0)
+        return false;
+
+    // the packets after the last one the client received, if it is still in the buffer
+    int from = -1;
+    for (int i = _m_replayBuffer.firstIndex(); i <= _m_replayBuffer.lastIndex(); ++i) {
+        if (_m_replayBuffer.at(i).globalSerial == lastSerial) {
+            from = i + 1;
+            break;
+        }
+    }
+    if (from == -1)
+        return false;
+
+    // Sent straight to the new socket before it is attached. Both happen on the room thread, the only one
+    // which appends to the buffer, so the packets sent after this one keep the order of the serials.
+    for (int i = from; i <= _m_replayBuffer.lastIndex(); ++i)
+        socket->send(_m_replayBuffer.at(i).toByteArray(features));
+
+    setSocket(socket);
+    return true;
+}
+
+void ServerPlayer::beginSnapshot()
+{
+    _m_isTakingSnapshot = true;
+    _m_snapshot.clear();
+}
+
+void ServerPlayer::endSnapshot()
+{
+    _m_isTakingSnapshot = false;
+
+    Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, S_COMMAND_ROOM_SNAPSHOT);
+    packet.setMessageBody(JsonArray() << S_ROOM_SNAPSHOT_VERSION << QVariant(_m_snapshot));
+    BroadcastPacket broadcastPacket(packet);
+
+    if (!broadcastPacket.encoded(protocolFeatures()).isEmpty()) {
+        unicast(broadcastPacket);
+    } else {
+        // too large for a single packet, send the collected notifications one by one
+        foreach (const QVariant &item, _m_snapshot) {
+            JsonArray command = item.value<JsonArray>();
+            notify(static_cast<CommandType>(command.value(0).toInt()), command.value(1));
+        }
+    }
+
+    _m_snapshot.clear();
 }
 
 void ServerPlayer::notify(CommandType type, const QVariant &arg)
 {
     Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, type);
     packet.setMessageBody(arg);
-    unicast(packet.toJson());
+    BroadcastPacket broadcastPacket(packet);
+    unicast(broadcastPacket);
 }
 
 QString ServerPlayer::reportHeader() const
@@ -33,6 +33,7 @@ struct PindianStruct;
 #include "player.h"
 
 #include <QSemaphore>
+#include <QContiguousCache>
 #include <QDateTime>
 
 #ifndef QT_NO_DEBUG
@@ -57,11 +58,20 @@ public:
     ~ServerPlayer();
 
     void setSocket(ClientSocket *socket);
-    void unicast(const QSanProtocol::AbstractPacket *packet);
+    void unicast(const QSanProtocol::Packet *packet);
     void notify(QSanProtocol::CommandType type, const QVariant &arg = QVariant());
     void kick();
     QString reportHeader() const;
     void unicast(const QByteArray &message);
+    void unicast(QSanProtocol::BroadcastPacket &packet);
+    int protocolFeatures() const;
+    // notifications between these 2 calls are collected and sent in one S_COMMAND_ROOM_SNAPSHOT,
+    // both are only called on the room thread, which sends all notifications
+    void beginSnapshot();
+    void endSnapshot();
+    // sends the packets after lastSerial to the socket, then attaches it. Returns false if they are not all kept
+    // any more, the socket is left alone then. Only called on the room thread.
+    bool resume(ClientSocket *socket, unsigned int lastSerial);
     void drawCard(const Card *card);
     Room *getRoom() const;
     void broadcastSkillInvoke(const Card *card) const;
@@ -232,6 +242,7 @@ protected:
     //Synchronization helpers
     QSemaphore **semas;
     static const int S_NUM_SEMAPHORES;
+    static const int S_REPLAY_BUFFER_SIZE;
 #ifndef QT_NO_DEBUG
     bool event(QEvent *event);
 #endif
@@ -250,6 +261,10 @@ private:
     QStringList selected; // 3v3 mode use only
     QDateTime test_time;
     QVariant _m_clientResponse;
+    bool _m_isTakingSnapshot;
+    QVariantList _m_snapshot;
+    bool _m_isResumable;
+    QContiguousCache<QSanProtocol::Packet> _m_replayBuffer;
 
 private slots:
     void getMessage(QByteArray request);
@@ -118,7 +118,7 @@ public:
 
             ServerPlayer *victim = room->askForPlayerChosen(target, players, objectName(), "@jglingfeng");
             if (victim == NULL)
-                victim = players.at(qrand() % players.length());
+                victim = room->random().pick(players);
 
             room->doAnimate(QSanProtocol::S_ANIMATE_INDICATE, target->objectName(), victim->objectName());
             room->loseHp(victim, 1);
@@ -444,7 +444,7 @@ public:
 
             ServerPlayer *t = room->askForPlayerChosen(target, friends, objectName(), "@jgzhinang:::" + choice);
             if (t == NULL)
-                t = friends.at(qrand() % friends.length());
+                t = room->random().pick(friends);
 
             room->clearAG(target);
 
@@ -1225,7 +1225,7 @@ public:
                     equips_candiscard << e;
             }
 
-            const Card *rand_c = equips_candiscard.at(qrand() % equips_candiscard.length());
+            const Card *rand_c = room->random().pick(equips_candiscard);
             room->throwCard(rand_c, skill_target);
         }
         return false;
@@ -523,7 +523,7 @@ public:
             if (targets.isEmpty()) {
                 delete kb;
             } else {
-                ServerPlayer *target = targets.at(qrand() % targets.length());
+                ServerPlayer *target = room->random().pick(targets);
                 room->useCard(CardUseStruct(kb, player, target), false);
             }
         }
@@ -37,7 +37,7 @@ void JiangeDefenseScenario::assign(QStringList &generals, QStringList &generals2
     shu_roles << "ghost" << "machine" << "human" << "human";
     roles.insert("wei", wei_roles);
     roles.insert("shu", shu_roles);
-    qShuffle(kingdoms);
+    room->random().shuffle(kingdoms);
     QStringList wei_generals, shu_generals;
     foreach (const QString &general, Sanguosha->getLimitedGeneralNames()) {
         if (general.startsWith("lord_")) continue;
@@ -48,8 +48,8 @@ void JiangeDefenseScenario::assign(QStringList &generals, QStringList &generals2
         else if (kingdom == "shu")
             shu_generals << general;
     }
-    qShuffle(wei_generals);
-    qShuffle(shu_generals);
+    room->random().shuffle(wei_generals);
+    room->random().shuffle(shu_generals);
     Q_ASSERT(wei_generals.length() >= 10 && shu_generals.length() >= 10);
     QMap<ServerPlayer *,QString> human_map; // Rara said, human couldn't get ghost or machine as its general.
     QList<ServerPlayer *> players = room->getPlayers();
@@ -59,7 +59,7 @@ void JiangeDefenseScenario::assign(QStringList &generals, QStringList &generals2
             foreach(const QString &kingdom, roles.keys())
                 if (roles[kingdom].contains("human"))
                     choices << kingdom;
-            QString choice = choices.at(qrand() % choices.length());
+            QString choice = room->random().pick(choices);
             QStringList role_list = roles[choice];
             role_list.removeOne("human");
             roles[choice] = role_list;
@@ -108,18 +108,18 @@ void JiangeDefenseScenario::assign(QStringList &generals, QStringList &generals2
             foreach(const QString &kingdom, roles.keys())
                 if (!roles[kingdom].isEmpty())
                     kingdom_choices << kingdom;
-            QString kingdom = kingdom_choices.at(qrand() % kingdom_choices.length());
+            QString kingdom = room->random().pick(kingdom_choices);
             kingdoms << kingdom;
             QStringList role_list = roles[kingdom];
-            QString role = role_list.at(qrand() % role_list.length());
+            QString role = room->random().pick(role_list);
             role_list.removeOne(role);
             roles[kingdom] = role_list;
             if (role == "ghost") {
-                QString name = kingdom == "wei" ? getRandomWeiGhost() : getRandomShuGhost();
+                QString name = kingdom == "wei" ? getRandomWeiGhost(room->random()) : getRandomShuGhost(room->random());
                 generals << name;
                 generals2 << name;
             } else if (role == "machine") {
-                QString name = kingdom == "wei" ? getRandomWeiMachine() : getRandomShuMachine();
+                QString name = kingdom == "wei" ? getRandomWeiMachine(room->random()) : getRandomShuMachine(room->random());
                 generals << name;
                 generals2 << name;
             } else if (role == "human") {
@@ -146,30 +146,30 @@ QString JiangeDefenseScenario::getRoles() const
 }
 
 
-QString JiangeDefenseScenario::getRandomWeiGhost() const
+QString JiangeDefenseScenario::getRandomWeiGhost(QSgsRandom &random) const
 {
     QStringList ghosts;
     ghosts << "jg_caozhen" << "jg_xiahou" << "jg_sima" << "jg_zhanghe";
-    return ghosts.at(qrand() % ghosts.length());
+    return random.pick(ghosts);
 }
 
-QString JiangeDefenseScenario::getRandomWeiMachine() const
+QString JiangeDefenseScenario::getRandomWeiMachine(QSgsRandom &random) const
 {
     QStringList machines;
     machines << "jg_bian_machine" << "jg_suanni_machine" << "jg_chiwen_machine" << "jg_yazi_machine";
-    return machines.at(qrand() % machines.length());
+    return random.pick(machines);
 }
 
-QString JiangeDefenseScenario::getRandomShuGhost() const
+QString JiangeDefenseScenario::getRandomShuGhost(QSgsRandom &random) const
 {
     QStringList ghosts;
     ghosts << "jg_liubei" << "jg_zhuge" << "jg_yueying" << "jg_pangtong";
-    return ghosts.at(qrand() % ghosts.length());
+    return random.pick(ghosts);
 }
 
-QString JiangeDefenseScenario::getRandomShuMachine() const
+QString JiangeDefenseScenario::getRandomShuMachine(QSgsRandom &random) const
 {
     QStringList machines;
     machines << "jg_qinglong_machine" << "jg_baihu_machine" << "jg_zhuque_machine" << "jg_xuanwu_machine";
-    return machines.at(qrand() % machines.length());
+    return random.pick(machines);
 }
@@ -4,6 +4,7 @@
 #include "scenario.h"
 
 class ServerPlayer;
+class QSgsRandom;
 
 class JiangeDefenseScenario : public Scenario
 {
@@ -16,10 +17,10 @@ public:
     virtual int getPlayerCount() const;
     virtual QString getRoles() const;
 
-    QString getRandomWeiGhost() const;
-    QString getRandomWeiMachine() const;
-    QString getRandomShuGhost() const;
-    QString getRandomShuMachine() const;
+    QString getRandomWeiGhost(QSgsRandom &random) const;
+    QString getRandomWeiMachine(QSgsRandom &random) const;
+    QString getRandomShuGhost(QSgsRandom &random) const;
+    QString getRandomShuMachine(QSgsRandom &random) const;
 };
 
 #endif
\ No newline at end of file
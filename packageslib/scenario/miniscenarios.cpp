@@ -165,10 +165,10 @@ bool MiniSceneRule::effect(TriggerEvent triggerEvent, Room *room, ServerPlayer *
         for (int i = 0; i < players.length(); i++)
             int_list << i;
         if (ex_options.contains(S_EXTRA_OPTION_RANDOM_ROLES))
-            qShuffle(int_list);
+            room->random().shuffle(int_list);
 
         QStringList all = Sanguosha->getRandomGenerals(Sanguosha->getGeneralCount());
-        qShuffle(all);
+        room->random().shuffle(all);
         for (int i = 0; i < players.length(); i++) {
             QString general = this->players[i]["general"];
             if (!general.isEmpty() && general != "select") all.removeOne(general);
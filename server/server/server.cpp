@@ -55,9 +55,10 @@ void Server::broadcastSystemMessage(const QString &msg)
 
     Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, S_COMMAND_SPEAK);
     packet.setMessageBody(arg);
+    BroadcastPacket broadcastPacket(packet);
 
     foreach(Room *room, rooms)
-        room->broadcast(&packet);
+        room->broadcast(broadcastPacket);
 }
 
 bool Server::listen()
@@ -102,8 +103,11 @@ void Server::processNewConnection(ClientSocket *socket)
     }
 
     connect(socket, &ClientSocket::disconnected, this, &Server::cleanup);
+    connect(socket, &ClientSocket::error_message, this, &Server::server_message);
+    connect(socket, &ClientSocket::congestion_changed, this, &Server::reportCongestion);
 
     notifyClient(socket, S_COMMAND_CHECK_VERSION, Sanguosha->getVersion());
+    notifyClient(socket, S_COMMAND_PROTOCOL_FEATURES, S_SUPPORTED_FEATURES);
     notifyClient(socket, S_COMMAND_SETUP, Sanguosha->getSetupString());
 
     emit server_message(tr("%1 connected").arg(socket->peerName()));
@@ -114,6 +118,9 @@ void Server::processNewConnection(ClientSocket *socket)
 void Server::processRequest(const QByteArray &request)
 {
     ClientSocket *socket = qobject_cast<ClientSocket *>(sender());
+    // message_got is queued from the I/O thread, so more packets may be on the way after the signup
+    if (signedUpSockets.contains(socket))
+        return;
 
     Packet packet;
     if (!packet.parse(request)) {
@@ -123,7 +130,10 @@ void Server::processRequest(const QByteArray &request)
 
     switch (packet.getPacketSource()) {
     case S_SRC_CLIENT:
-        processClientRequest(socket, packet);
+        if (packet.getCommandType() == S_COMMAND_CHECK_VERSION)
+            negotiateFeatures(socket, packet);
+        else
+            processClientRequest(socket, packet);
         break;
     default:
         emit server_message(tr("Packet %1 from an unknown source %2").arg(QString::fromUtf8(request)).arg(socket->peerAddress()));
@@ -134,12 +144,31 @@ void Server::notifyClient(ClientSocket *socket, CommandType command, const QVari
 {
     Packet packet(S_SRC_ROOM | S_TYPE_NOTIFICATION | S_DEST_CLIENT, command);
     packet.setMessageBody(arg);
-    socket->send(packet.toJson());
+    socket->send(packet.toByteArray(socket->protocolFeatures()));
+}
+
+void Server::negotiateFeatures(ClientSocket *socket, const Packet &offer)
+{
+    JsonArray body = offer.getMessageBody().value<JsonArray>();
+    int accepted = body.value(1).toInt() & S_SUPPORTED_FEATURES;
+    // binary packets can contain newlines, so they can't be sent without the length prefix
+    if (!(accepted & S_FEATURE_LENGTH_PREFIXED_FRAME))
+        accepted &= ~S_FEATURE_BINARY_CODEC;
+
+    // The acknowledgement itself is still sent in the old format, the client switches after receiving it.
+    // setFraming() is queued to the I/O thread after the acknowledgement, so it can't overtake it.
+    notifyClient(socket, S_COMMAND_CHECK_VERSION, JsonArray() << Sanguosha->getVersion() << accepted);
+
+    if (accepted & S_FEATURE_LENGTH_PREFIXED_FRAME)
+        socket->setFraming(ClientSocket::LengthPrefixedFraming);
+    // only packets encoded from now on can be binary, and they are queued after the framing change
+    socket->setProtocolFeatures(accepted);
 }
 
 void Server::processClientRequest(ClientSocket *socket, const Packet &signup)
 {
     disconnect(socket, &ClientSocket::message_got, this, &Server::processRequest);
+    signedUpSockets.insert(socket);
 
     if (signup.getCommandType() != S_COMMAND_SIGNUP) {
         emit server_message(tr("Invalid signup string: %1").arg(signup.toString()));
@@ -152,12 +181,14 @@ void Server::processClientRequest(ClientSocket *socket, const Packet &signup)
     bool is_reconnection = body[0].toBool();
     QString screen_name = body[1].toString();
     QString avatar = body[2].toString();
+    // the last packet a client resuming its session received, see S_FEATURE_SESSION_RESUME
+    unsigned int last_serial = body.value(3).toUInt();
 
     if (is_reconnection) {
         foreach (const QString &objname, name2objname.values(screen_name)) {
             ServerPlayer *player = players.value(objname);
             if (player && player->getState() == "offline" && !player->getRoom()->isFinished()) {
-                player->getRoom()->reconnect(player, socket);
+                player->getRoom()->reconnect(player, socket, last_serial);
                 return;
             }
         }
@@ -181,9 +212,31 @@ void Server::cleanup()
     ClientSocket *socket = qobject_cast<ClientSocket *>(sender());
     if (Config.ForbidSIMC)
         addresses.removeOne(socket->peerAddress());
+    signedUpSockets.remove(socket);
+
+    ClientSocket::OutboundStatistics statistics = socket->outboundStatistics();
+    if (statistics.congestions > 0) {
+        emit server_message(tr("%1 was congested %2 times, %3 of %4 messages dropped, peak queue %5 bytes")
+                                .arg(socket->peerName())
+                                .arg(statistics.congestions)
+                                .arg(statistics.droppedMessages)
+                                .arg(statistics.sentMessages + statistics.droppedMessages)
+                                .arg(statistics.peakPendingBytes));
+    }
+
     socket->deleteLater();
 }
 
+void Server::reportCongestion(bool congested)
+{
+    // the connection itself is aborted by the socket once its queue exceeds the limit
+    ClientSocket *socket = qobject_cast<ClientSocket *>(sender());
+    if (congested)
+        emit server_message(tr("%1 is congested, droppable messages to it are dropped").arg(socket->peerName()));
+    else
+        emit server_message(tr("%1 has caught up").arg(socket->peerName()));
+}
+
 void Server::signupPlayer(ServerPlayer *player)
 {
     name2objname.insert(player->screenName(), player->objectName());
@@ -54,18 +54,22 @@ private:
     void notifyClient(ClientSocket *socket, QSanProtocol::CommandType command, const QVariant &arg = QVariant());
 
     void processClientRequest(ClientSocket *socket, const QSanProtocol::Packet &signup);
+    void negotiateFeatures(ClientSocket *socket, const QSanProtocol::Packet &offer);
 
     ServerSocket *server;
     Room *current;
     QSet<Room *> rooms;
     QHash<QString, ServerPlayer *> players;
     QStringList addresses;
+    // packets queued to processRequest() before it was disconnected from a socket are dropped for these
+    QSet<ClientSocket *> signedUpSockets;
     QMultiHash<QString, QString> name2objname;
 
 private slots:
     void processNewConnection(ClientSocket *socket);
     void processRequest(const QByteArray &request);
     void cleanup();
+    void reportCongestion(bool congested);
     void gameOver();
 
 signals: